@@ -1,7 +1,12 @@
 #!/bin/sh
 set -e
 
-make -C /chessh -B
+# CHESSH_BUILD=lto or CHESSH_BUILD=pgo builds an optimized chessh instead
+if [ -n "$CHESSH_BUILD" ]; then
+	make -C /chessh "$CHESSH_BUILD"
+else
+	make -C /chessh -B
+fi
 make -C /chessh/src/frontends -B
 
 passwd -d root
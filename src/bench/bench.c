@@ -0,0 +1,834 @@
+/* chessh - chess over ssh
+ * Copyright (C) 2024  Nate Choe <nate@natechoe.dev>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * */
+/* micro-benchmarks for the engine's hot paths, run with `make bench` */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <stdint.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <getopt.h>
+
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#include <util.h>
+#include <client/api.h>
+#include <client/chess.h>
+#include <client/perft.h>
+
+/* batches of operations are timed instead of single operations, this is
+ * roughly how long a batch should take */
+#define BATCH_NS 50000
+#define MIN_BATCHES 20
+#define MAX_BATCHES 100000
+
+/* the longest benchmark name that a baseline file can hold */
+#define MAX_NAME 64
+/* xorshift steps in one operation of the reference benchmark */
+#define REFERENCE_STEPS 64
+
+/* the level of the fast_perft benchmark, counting the root as 1 */
+#define PERFT_LEVEL 4
+/* the longest game that replay_game plays through */
+#define MAX_REPLAY 256
+/* how many times poll_valid_moves asks for each position's moves */
+#define POLLS_PER_POSITION 8
+
+/* a fixed mix of opening, middlegame and endgame positions */
+static char *corpus_fens[] = {
+	"rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+	"r1bqkb1r/pppp1ppp/2n2n2/4p3/2B1P3/5N2/PPPP1PPP/RNBQK2R w KQkq - 4 4",
+	"r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+	"r4rk1/1pp1qppp/p1np1n2/2b1p1B1/2B1P1b1/P1NP1N2/1PP1QPP1/R4RK1 w - - 0 10",
+	"rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8",
+	"r2q1rk1/pP1p2pp/Q4n2/bbp1p3/Np6/1B3NBn/pPPP1PPP/R3K2R b KQ - 0 1",
+	"2r2rk1/pp1bqpp1/2n1p2p/3pP3/3P4/P1PB1N2/5PPP/R2Q1RK1 b - - 0 17",
+	"8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1",
+	"8/8/1k6/2b5/2pP4/8/5K2/8 b - d3 0 1",
+	"n1n5/PPPk4/8/8/8/8/4Kppp/5N1N b - - 0 1",
+	"8/5pk1/6p1/8/3R4/6P1/5PK1/2r5 w - - 0 40",
+	"4k3/8/8/8/8/8/8/R3K2R w KQ - 0 1",
+};
+#define CORPUS_SIZE (sizeof corpus_fens / sizeof *corpus_fens)
+
+struct position {
+	char *fen;
+	struct game *game;
+};
+
+/* every legal move of every position in the corpus */
+struct sample {
+	struct position *position;
+	struct move move;
+	char text[MOVE_STRING_SIZE];
+};
+
+struct bench {
+	char *name;
+	/* runs operation number `i`, returns something depending on the
+	 * result */
+	uintptr_t (*run)(unsigned long i);
+};
+
+/* the statistics of one benchmark, either for one run or summarized over
+ * several */
+struct result {
+	double ns_per_op;
+	double p50;
+	double p90;
+	double p99;
+	double cycles_per_op; /* 0 without counters */
+	double instructions_per_op;
+	/* calls to malloc(), calloc() and realloc() from the engine */
+	double allocs_per_op;
+
+	/* the fastest run's ns_per_op, and the median absolute deviation of
+	 * ns_per_op between runs */
+	double best;
+	double mad;
+};
+
+struct counters {
+	int cycles_fd;
+	int instructions_fd;
+};
+
+static struct position positions[CORPUS_SIZE];
+static struct sample *samples;
+static unsigned long sample_count;
+static struct game *scratch;
+/* a deterministic game from the starting position, as a session sees it */
+static char replay_moves[MAX_REPLAY][MOVE_STRING_SIZE];
+static int replay_length;
+static struct game_storage replay_storage;
+static struct game *replay;
+static struct move_cache poll_cache;
+/* counted by the --wrap'd allocator functions below */
+static unsigned long allocations;
+/* results go here, stdout is sent to /dev/null while benchmarking */
+static FILE *out;
+/* benchmark results are stored here so they can't be optimized out */
+static volatile uintptr_t sink;
+
+/* doesn't touch the engine, it's there to measure how fast the machine is */
+static uintptr_t bench_reference(unsigned long i);
+static uintptr_t bench_make_move(unsigned long i);
+static uintptr_t bench_init_game(unsigned long i);
+static uintptr_t bench_parse_move(unsigned long i);
+static uintptr_t bench_move_to_string(unsigned long i);
+static uintptr_t bench_generate_legal_moves(unsigned long i);
+static uintptr_t bench_has_legal_move(unsigned long i);
+static uintptr_t bench_legal_moves_from(unsigned long i);
+static uintptr_t bench_count_valid_moves(unsigned long i);
+static uintptr_t bench_api_send_board(unsigned long i);
+static uintptr_t bench_poll_valid_moves(unsigned long i);
+static uintptr_t bench_fast_perft(unsigned long i);
+static uintptr_t bench_replay_game(unsigned long i);
+
+/* reference has to come first, check_baseline() reads it before anything it
+ * scales */
+static struct bench benches[] = {
+	{ "reference", bench_reference },
+	{ "make_move", bench_make_move },
+	{ "init_game", bench_init_game },
+	{ "parse_move", bench_parse_move },
+	{ "move_to_string", bench_move_to_string },
+	{ "generate_legal_moves", bench_generate_legal_moves },
+	{ "has_legal_move", bench_has_legal_move },
+	{ "legal_moves_from", bench_legal_moves_from },
+	{ "count_valid_moves", bench_count_valid_moves },
+	{ "api_send_board", bench_api_send_board },
+	{ "poll_valid_moves", bench_poll_valid_moves },
+	{ "fast_perft", bench_fast_perft },
+	{ "replay_game", bench_replay_game },
+};
+#define BENCH_COUNT (sizeof benches / sizeof *benches)
+
+/* returns -1 on error */
+static int load_corpus(void);
+/* plays the game that replay_game replays, returns -1 on error */
+static int record_replay(void);
+
+/* the bench is linked with --wrap for these, so every allocation made by
+ * the engine is counted */
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t count, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+void *__wrap_malloc(size_t size);
+void *__wrap_calloc(size_t count, size_t size);
+void *__wrap_realloc(void *ptr, size_t size);
+
+/* opens hardware counters for this process, returns -1 if the kernel won't
+ * allow it */
+static int open_counters(struct counters *counters);
+static uint64_t read_counter(int fd);
+
+/* times `bench` for about `seconds` */
+static void run_bench(struct bench *bench, double seconds, struct counters *counters,
+		struct result *ret);
+
+/* takes the median of every statistic over several runs, along with the
+ * fastest run and the spread between them */
+static void summarize(struct result *runs, int run_count, struct result *ret);
+static void print_result(char *name, struct result *result, bool counters);
+
+/* the baseline is a JSON object mapping benchmark names to
+ * {"ns_per_op": x, "best": y, "mad": z, "allocs": n}, one per line. It's read back with sscanf(), so
+ * it has to stay in exactly the format that write_baseline() uses. */
+static int write_baseline(char *path, bool *ran, struct result *results);
+
+/* compares results against a baseline written by write_baseline(). The
+ * baseline's times are first scaled by how much faster or slower the
+ * reference benchmark runs now, so a baseline from another machine is
+ * roughly comparable. Other processes can only ever slow a benchmark down, so
+ * a benchmark regresses if its fastest run and its median are both more than
+ * `threshold` percent slower than the baseline's, however noisy the runs
+ * were. If only one of them is, it's reported as noise. Allocations aren't
+ * noisy, any more than the baseline's is a regression. Returns the number of regressions, or -1 on
+ * error. */
+static int check_baseline(char *path, bool *ran, struct result *results, double threshold);
+
+static double median(double *values, int count);
+static int compare_doubles(const void *a, const void *b);
+static double get_ns(void);
+static void print_help(char *progname);
+
+int main(int argc, char *argv[]) {
+	static struct result results[BENCH_COUNT];
+	static bool ran[BENCH_COUNT];
+	struct counters counters, *use_counters;
+	struct result *runs;
+	char *baseline_out, *baseline_in;
+	double seconds, threshold;
+	bool want_counters;
+	int run_count, devnull, saved_stdout;
+
+	seconds = 0.5;
+	want_counters = false;
+	run_count = 1;
+	baseline_out = baseline_in = NULL;
+	threshold = 10;
+	for (;;) {
+		int opt = getopt(argc, argv, "ht:pr:o:c:x:");
+		switch (opt) {
+		case -1:
+			goto got_args;
+		case 't':
+			if ((seconds = atof(optarg) / 1000) <= 0) {
+				fprintf(stderr, "%s: invalid time\n", argv[0]);
+				return 1;
+			}
+			break;
+		case 'p':
+			want_counters = true;
+			break;
+		case 'r':
+			if ((run_count = atoi(optarg)) <= 0) {
+				fprintf(stderr, "%s: invalid number of runs\n", argv[0]);
+				return 1;
+			}
+			break;
+		case 'o':
+			baseline_out = optarg;
+			break;
+		case 'c':
+			baseline_in = optarg;
+			break;
+		case 'x':
+			if ((threshold = atof(optarg)) <= 0) {
+				fprintf(stderr, "%s: invalid threshold\n", argv[0]);
+				return 1;
+			}
+			break;
+		case 'h':
+			print_help(argv[0]);
+			return 0;
+		default:
+			print_help(argv[0]);
+			return 1;
+		}
+	}
+got_args:
+
+	if (load_corpus() < 0 || record_replay() < 0) {
+		fputs("Failed to load the position corpus\n", stderr);
+		return 1;
+	}
+
+	if ((runs = malloc(BENCH_COUNT * run_count * sizeof *runs)) == NULL) {
+		fputs("Failed to allocate memory\n", stderr);
+		return 1;
+	}
+
+	use_counters = NULL;
+	if (want_counters) {
+		if (open_counters(&counters) < 0) {
+			perror("perf_event_open() failed, not counting cycles");
+		}
+		else {
+			use_counters = &counters;
+		}
+	}
+
+	/* api_send_board() writes to stdout, send that somewhere harmless
+	 * while keeping the results on the real stdout */
+	fflush(stdout);
+	if ((saved_stdout = dup(STDOUT_FILENO)) < 0 ||
+	    (out = fdopen(saved_stdout, "w")) == NULL ||
+	    (devnull = open("/dev/null", O_WRONLY)) < 0 ||
+	    dup2(devnull, STDOUT_FILENO) < 0) {
+		perror("Failed to redirect stdout");
+		return 1;
+	}
+	setvbuf(out, NULL, _IOLBF, 0);
+
+	fprintf(out, "%lu positions, %lu moves, %d run%s per benchmark\n",
+			(unsigned long) CORPUS_SIZE, sample_count,
+			run_count, run_count == 1 ? "" : "s");
+	fprintf(out, "%-22s %10s %8s %10s %12s %10s %10s %10s %9s", "benchmark",
+			"ns/op", "+/-", "best", "ops/s", "p50", "p90", "p99", "allocs/op");
+	if (use_counters != NULL) {
+		fprintf(out, " %10s %10s %6s", "cycles/op", "instrs/op", "IPC");
+	}
+	fputc('\n', out);
+
+	for (size_t i = 0; i < BENCH_COUNT; ++i) {
+		bool wanted = optind >= argc;
+		for (int j = optind; j < argc; ++j) {
+			wanted |= strcmp(argv[j], benches[i].name) == 0;
+		}
+		if (!wanted) {
+			continue;
+		}
+
+		ran[i] = true;
+	}
+	/* baselines are scaled by the reference benchmark */
+	if (baseline_out != NULL || baseline_in != NULL) {
+		ran[0] = true;
+	}
+
+	/* runs are interleaved so that a burst of activity elsewhere on the
+	 * machine is spread over every benchmark */
+	for (int j = 0; j < run_count; ++j) {
+		for (size_t i = 0; i < BENCH_COUNT; ++i) {
+			if (ran[i]) {
+				run_bench(&benches[i], seconds, use_counters, &runs[i * run_count + j]);
+			}
+		}
+	}
+
+	for (size_t i = 0; i < BENCH_COUNT; ++i) {
+		if (ran[i]) {
+			summarize(&runs[i * run_count], run_count, &results[i]);
+			print_result(benches[i].name, &results[i], use_counters != NULL);
+		}
+	}
+	free(runs);
+
+	if (baseline_out != NULL) {
+		if (write_baseline(baseline_out, ran, results) < 0) {
+			perror("Failed to write the baseline");
+			return 1;
+		}
+		fprintf(out, "Wrote the baseline to %s\n", baseline_out);
+	}
+
+	if (baseline_in != NULL) {
+		int regressions = check_baseline(baseline_in, ran, results, threshold);
+		if (regressions < 0) {
+			perror("Failed to read the baseline");
+			return 1;
+		}
+		if (regressions > 0) {
+			fprintf(out, "%d benchmark%s regressed by more than %g%% or "
+					"allocated more\n",
+					regressions, regressions == 1 ? "" : "s", threshold);
+			return 1;
+		}
+		fprintf(out, "No regressions past %g%%\n", threshold);
+	}
+
+	return 0;
+}
+
+static int load_corpus(void) {
+	unsigned long alloc;
+
+	if ((scratch = new_game()) == NULL) {
+		return -1;
+	}
+
+	alloc = 0;
+	sample_count = 0;
+	for (size_t i = 0; i < CORPUS_SIZE; ++i) {
+		struct move moves[MAX_MOVES];
+		int move_count;
+
+		positions[i].fen = corpus_fens[i];
+		if ((positions[i].game = new_game()) == NULL ||
+		    init_game(positions[i].game, corpus_fens[i]) != 0) {
+			fprintf(stderr, "Bad corpus position %s\n", corpus_fens[i]);
+			return -1;
+		}
+
+		move_count = generate_legal_moves(positions[i].game, moves);
+		for (int j = 0; j < move_count; ++j) {
+			if (sample_count >= alloc) {
+				struct sample *new_samples;
+				alloc = alloc == 0 ? 256 : alloc * 2;
+				if ((new_samples = realloc(samples, alloc * sizeof *samples)) == NULL) {
+					return -1;
+				}
+				samples = new_samples;
+			}
+
+			samples[sample_count].position = &positions[i];
+			samples[sample_count].move = moves[j];
+			move_to_string(&moves[j], samples[sample_count].text);
+			++sample_count;
+		}
+	}
+
+	return 0;
+}
+
+static int record_replay(void) {
+	struct game_storage storage;
+	struct game *game = init_game_storage(&storage);
+
+	for (replay_length = 0; replay_length < MAX_REPLAY; ++replay_length) {
+		struct move moves[MAX_MOVES];
+		int move_count = generate_legal_moves(game, moves);
+		struct move *move;
+
+		if (move_count == 0) {
+			break;
+		}
+		/* anything that isn't the first move, so that the game goes
+		 * somewhere */
+		move = &moves[(replay_length * 7 + 3) % move_count];
+		move_to_string(move, replay_moves[replay_length]);
+		if (make_move(game, move) < 0) {
+			++replay_length;
+			break;
+		}
+	}
+
+	return replay_length > 0 ? 0 : -1;
+}
+
+void *__wrap_malloc(size_t size) {
+	++allocations;
+	return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t count, size_t size) {
+	++allocations;
+	return __real_calloc(count, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size) {
+	++allocations;
+	return __real_realloc(ptr, size);
+}
+
+static uintptr_t bench_reference(unsigned long i) {
+	uint64_t x = i + 1;
+
+	/* every step depends on the last, so this can't be vectorized */
+	for (int j = 0; j < REFERENCE_STEPS; ++j) {
+		x ^= x << 13;
+		x ^= x >> 7;
+		x ^= x << 17;
+	}
+	return x;
+}
+
+static uintptr_t bench_make_move(unsigned long i) {
+	struct sample *sample = &samples[i % sample_count];
+	struct move move = sample->move;
+	struct game copy;
+
+	/* make_move() has no undo, so this includes copying the game. The copy
+	 * doesn't get the history, or it would write into the corpus game's. */
+	memcpy(&copy, sample->position->game, sizeof copy);
+	copy.history = NULL;
+	return (uintptr_t) make_move(&copy, &move) + copy.key;
+}
+
+static uintptr_t bench_init_game(unsigned long i) {
+	return (uintptr_t) init_game(scratch, positions[i % CORPUS_SIZE].fen) + scratch->key;
+}
+
+static uintptr_t bench_parse_move(unsigned long i) {
+	struct move move;
+	parse_move(&move, samples[i % sample_count].text);
+	return (uintptr_t) move.bits;
+}
+
+static uintptr_t bench_move_to_string(unsigned long i) {
+	char text[MOVE_STRING_SIZE];
+	move_to_string(&samples[i % sample_count].move, text);
+	return (uintptr_t) text[0];
+}
+
+static uintptr_t bench_generate_legal_moves(unsigned long i) {
+	struct move moves[MAX_MOVES];
+	return (uintptr_t) generate_legal_moves(positions[i % CORPUS_SIZE].game, moves);
+}
+
+static uintptr_t bench_has_legal_move(unsigned long i) {
+	return (uintptr_t) has_legal_move(positions[i % CORPUS_SIZE].game);
+}
+
+/* every piece that can move, as a client would ask about them */
+static uintptr_t bench_legal_moves_from(unsigned long i) {
+	struct sample *sample = &samples[i % sample_count];
+	return (uintptr_t) legal_moves_from(sample->position->game, move_from(sample->move));
+}
+
+static uintptr_t bench_count_valid_moves(unsigned long i) {
+	char buff[1024];
+	return (uintptr_t) count_valid_moves(positions[i % CORPUS_SIZE].game, buff, sizeof buff);
+}
+
+static uintptr_t bench_api_send_board(unsigned long i) {
+	api_send_board(positions[i % CORPUS_SIZE].game);
+	return 0;
+}
+
+/* a client asking for the valid moves several times a turn */
+static uintptr_t bench_poll_valid_moves(unsigned long i) {
+	api_send_valid_moves(&poll_cache,
+			positions[i / POLLS_PER_POSITION % CORPUS_SIZE].game);
+	return (uintptr_t) poll_cache.length;
+}
+
+static uintptr_t bench_fast_perft(unsigned long i) {
+	unsigned long long results[PERFT_LEVEL];
+	count_perft(positions[i % CORPUS_SIZE].game, PERFT_LEVEL, results);
+	return (uintptr_t) results[PERFT_LEVEL - 1];
+}
+
+/* one ply of a session, everything the api frontend and runner do for a move
+ * besides the I/O itself */
+static uintptr_t bench_replay_game(unsigned long i) {
+	char buff[1024], text[MOVE_STRING_SIZE];
+	int ply = i % replay_length;
+	struct move move;
+	uintptr_t ret;
+
+	if (ply == 0) {
+		replay = init_game_storage(&replay_storage);
+	}
+	ret = count_valid_moves(replay, buff, sizeof buff);
+	parse_move(&move, replay_moves[ply]);
+	ret += make_move(replay, &move);
+	ret += (uintptr_t) move_to_string(&move, text)[0];
+	api_send_board(replay);
+	return ret;
+}
+
+static int open_counters(struct counters *counters) {
+	struct perf_event_attr attr;
+
+	memset(&attr, 0, sizeof attr);
+	attr.size = sizeof attr;
+	attr.type = PERF_TYPE_HARDWARE;
+	attr.disabled = 1;
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+
+	attr.config = PERF_COUNT_HW_CPU_CYCLES;
+	counters->cycles_fd = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+	if (counters->cycles_fd < 0) {
+		return -1;
+	}
+
+	attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+	counters->instructions_fd = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+	if (counters->instructions_fd < 0) {
+		close(counters->cycles_fd);
+		return -1;
+	}
+
+	return 0;
+}
+
+static uint64_t read_counter(int fd) {
+	uint64_t ret;
+	if (read(fd, &ret, sizeof ret) != sizeof ret) {
+		return 0;
+	}
+	return ret;
+}
+
+static void run_bench(struct bench *bench, double seconds, struct counters *counters,
+		struct result *ret) {
+	static double batch_ns[MAX_BATCHES];
+	unsigned long batch_size, op, total_ops;
+	double start, total_ns;
+	uint64_t cycles, instructions;
+	unsigned long start_allocations;
+	int batches;
+
+	/* warm up and find a batch size that takes about BATCH_NS */
+	sink = 0;
+	op = 0;
+	for (batch_size = 1;; batch_size *= 2) {
+		double batch_start = get_ns();
+		for (unsigned long i = 0; i < batch_size; ++i) {
+			sink += bench->run(op++);
+		}
+		if (get_ns() - batch_start >= BATCH_NS || batch_size >= 1ul << 30) {
+			break;
+		}
+	}
+
+	if (counters != NULL) {
+		ioctl(counters->cycles_fd, PERF_EVENT_IOC_RESET, 0);
+		ioctl(counters->instructions_fd, PERF_EVENT_IOC_RESET, 0);
+		ioctl(counters->cycles_fd, PERF_EVENT_IOC_ENABLE, 0);
+		ioctl(counters->instructions_fd, PERF_EVENT_IOC_ENABLE, 0);
+	}
+
+	total_ns = 0;
+	total_ops = 0;
+	start_allocations = allocations;
+	start = get_ns();
+	for (batches = 0; batches < MAX_BATCHES; ++batches) {
+		double batch_start, elapsed;
+
+		if (batches >= MIN_BATCHES && get_ns() - start >= seconds * 1e9) {
+			break;
+		}
+
+		batch_start = get_ns();
+		for (unsigned long i = 0; i < batch_size; ++i) {
+			sink += bench->run(op++);
+		}
+		elapsed = get_ns() - batch_start;
+
+		batch_ns[batches] = elapsed / batch_size;
+		total_ns += elapsed;
+		total_ops += batch_size;
+	}
+
+	cycles = instructions = 0;
+	if (counters != NULL) {
+		ioctl(counters->cycles_fd, PERF_EVENT_IOC_DISABLE, 0);
+		ioctl(counters->instructions_fd, PERF_EVENT_IOC_DISABLE, 0);
+		cycles = read_counter(counters->cycles_fd);
+		instructions = read_counter(counters->instructions_fd);
+	}
+
+	qsort(batch_ns, batches, sizeof *batch_ns, compare_doubles);
+
+	ret->ns_per_op = total_ns / total_ops;
+	ret->p50 = batch_ns[batches / 2];
+	ret->p90 = batch_ns[batches * 9 / 10];
+	ret->p99 = batch_ns[batches * 99 / 100];
+	ret->cycles_per_op = (double) cycles / total_ops;
+	ret->instructions_per_op = (double) instructions / total_ops;
+	ret->allocs_per_op = (double) (allocations - start_allocations) / total_ops;
+	ret->best = ret->ns_per_op;
+	ret->mad = 0;
+}
+
+static void summarize(struct result *runs, int run_count, struct result *ret) {
+	double values[run_count];
+
+#define MEDIAN_OF(field) \
+	for (int i = 0; i < run_count; ++i) { \
+		values[i] = runs[i].field; \
+	} \
+	ret->field = median(values, run_count);
+
+	MEDIAN_OF(ns_per_op);
+	MEDIAN_OF(p50);
+	MEDIAN_OF(p90);
+	MEDIAN_OF(p99);
+	MEDIAN_OF(cycles_per_op);
+	MEDIAN_OF(instructions_per_op);
+	MEDIAN_OF(allocs_per_op);
+#undef MEDIAN_OF
+
+	ret->best = runs[0].ns_per_op;
+	for (int i = 0; i < run_count; ++i) {
+		if (runs[i].ns_per_op < ret->best) {
+			ret->best = runs[i].ns_per_op;
+		}
+		values[i] = fabs(runs[i].ns_per_op - ret->ns_per_op);
+	}
+	ret->mad = median(values, run_count);
+}
+
+static void print_result(char *name, struct result *result, bool counters) {
+	fprintf(out, "%-22s %10.1f %8.1f %10.1f %12.0f %10.1f %10.1f %10.1f %9.2f", name,
+			result->ns_per_op, result->mad, result->best, 1e9 / result->ns_per_op,
+			result->p50, result->p90, result->p99, result->allocs_per_op);
+	if (counters) {
+		fprintf(out, " %10.1f %10.1f %6.2f",
+				result->cycles_per_op, result->instructions_per_op,
+				result->cycles_per_op > 0 ?
+				result->instructions_per_op / result->cycles_per_op : 0);
+	}
+	fputc('\n', out);
+}
+
+static int write_baseline(char *path, bool *ran, struct result *results) {
+	FILE *file;
+	bool first;
+
+	if ((file = fopen(path, "w")) == NULL) {
+		return -1;
+	}
+
+	fputs("{\n", file);
+	first = true;
+	for (size_t i = 0; i < BENCH_COUNT; ++i) {
+		if (!ran[i]) {
+			continue;
+		}
+		fprintf(file, "%s\t\"%s\": {\"ns_per_op\": %.2f, \"best\": %.2f, \"mad\": %.2f, "
+				"\"allocs\": %.2f}",
+				first ? "" : ",\n", benches[i].name,
+				results[i].ns_per_op, results[i].best, results[i].mad,
+				results[i].allocs_per_op);
+		first = false;
+	}
+	fputs("\n}\n", file);
+
+	return fclose(file) == 0 ? 0 : -1;
+}
+
+static int check_baseline(char *path, bool *ran, struct result *results, double threshold) {
+	FILE *file;
+	char line[256];
+	double scale;
+	int regressions;
+
+	if ((file = fopen(path, "r")) == NULL) {
+		return -1;
+	}
+
+	fprintf(out, "\nCompared to %s:\n", path);
+	fprintf(out, "%-22s %10s %10s %8s %8s\n", "benchmark",
+			"baseline", "current", "best", "median");
+	regressions = 0;
+	scale = 1;
+	while (fgets(line, sizeof line, file) != NULL) {
+		char name[MAX_NAME];
+		double base, base_best, base_mad, base_allocs, change, best_change;
+		struct result *result;
+		char *verdict;
+
+		if (sscanf(line, " \"%63[^\"]\": {\"ns_per_op\": %lf, \"best\": %lf, \"mad\": %lf, "
+				"\"allocs\": %lf}",
+				name, &base, &base_best, &base_mad, &base_allocs) != 5) {
+			continue;
+		}
+
+		result = NULL;
+		for (size_t i = 0; i < BENCH_COUNT; ++i) {
+			if (ran[i] && strcmp(benches[i].name, name) == 0) {
+				result = &results[i];
+				break;
+			}
+		}
+		if (result == NULL) {
+			continue;
+		}
+
+		if (result == &results[0]) {
+			/* the fastest run is the one least disturbed by anything
+			 * else on the machine */
+			scale = result->best / base_best;
+			fprintf(out, "%-22s %10.1f %10.1f %8s %8s scaling the baseline by %.2f\n",
+					name, base_best, result->best, "", "", scale);
+			continue;
+		}
+		base *= scale;
+		base_best *= scale;
+
+		change = (result->ns_per_op - base) / base * 100;
+		best_change = (result->best - base_best) / base_best * 100;
+
+		/* the baseline only has two decimals */
+		if (result->allocs_per_op > base_allocs + 0.005) {
+			verdict = "ALLOCATES";
+			++regressions;
+		}
+		else if (best_change > threshold && change > threshold) {
+			verdict = "REGRESSED";
+			++regressions;
+		}
+		else if (best_change > threshold || change > threshold) {
+			verdict = "ok (noisy)";
+		}
+		else {
+			verdict = "ok";
+		}
+
+		fprintf(out, "%-22s %10.1f %10.1f %+7.1f%% %+7.1f%% %s\n", name,
+				base_best, result->best, best_change, change, verdict);
+	}
+
+	fclose(file);
+	return regressions;
+}
+
+static double median(double *values, int count) {
+	qsort(values, count, sizeof *values, compare_doubles);
+	if (count % 2 == 0) {
+		return (values[count / 2 - 1] + values[count / 2]) / 2;
+	}
+	return values[count / 2];
+}
+
+static int compare_doubles(const void *a, const void *b) {
+	double x = *(const double *) a, y = *(const double *) b;
+	return (x > y) - (x < y);
+}
+
+static double get_ns(void) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec * 1e9 + now.tv_nsec;
+}
+
+static void print_help(char *progname) {
+	printf("Usage: %s [-t ms] [-p] [-r runs] [-o file] [-c file] [-x percent] [benchmark...]\n", progname);
+	puts("Times the engine's hot paths over a fixed set of positions.");
+	puts("  -h: Show this help and quit");
+	puts("  -t [ms]: Run each benchmark for about [ms] milliseconds (default 500)");
+	puts("  -p: Also count cycles and instructions with perf_event_open()");
+	puts("  -r [runs]: Run each benchmark [runs] times and report the median (default 1)");
+	puts("  -o [file]: Write the results to [file] as a baseline");
+	puts("  -c [file]: Compare the results to the baseline in [file], exit with 1");
+	puts("             if anything got slower or allocates more. Baselines are scaled");
+	puts("             by the reference benchmark, but one from another machine is");
+	puts("             only a rough guide, write a new one with -o first");
+	puts("  -x [percent]: With -c, how much slower counts as a regression (default 10)");
+	puts("With no benchmarks named, all of them run.");
+}
@@ -0,0 +1,690 @@
+/* chessh - chess over ssh
+ * Copyright (C) 2024  Nate Choe <nate@natechoe.dev>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * */
+/* differential fuzzer: plays random games and checks that the move generator,
+ * make_move() and do_move()/undo_move() agree with the original 8x8 engine in
+ * oracle.c, which shares no code with them. Run with `make fuzz`. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <getopt.h>
+
+#include <util.h>
+#include <client/chess.h>
+#include <bench/oracle.h>
+
+/* games can go on for a while since draw offers are declined, but the 150 move
+ * rule always ends them */
+#define MAX_PLIES 1024
+
+/* room for every from/to pair, with every promotion */
+#define MAX_PROBED (64 * 64 * 4)
+
+/* room for describing a divergence */
+#define REPORT_SIZE 512
+
+/* the outcome of a move as make_move() would report it, for comparing it to the
+ * oracle */
+enum outcome {
+	PLAYING,
+	CHECKMATE,
+	STALEMATE
+};
+
+/* random games start from one of these, so that castling, en pessant and
+ * promotions come up much more often than they would from the start */
+static char *start_fens[] = {
+	"rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+	"r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+	"8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1",
+	"r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1",
+	"rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8",
+	"n1n5/PPPk4/8/8/8/8/4Kppp/5N1N b - - 0 1",
+	"r3k2r/8/8/8/3pPp2/8/8/R3K2R b KQkq e3 0 1",
+	"4k3/1P6/8/8/8/8/6p1/4K3 w - - 0 1",
+};
+#define START_COUNT (sizeof start_fens / sizeof *start_fens)
+
+/* a random position, as both implementations see it */
+struct sample {
+	struct game game;
+	struct oracle_game oracle;
+};
+
+static uint64_t rng_state;
+
+static uint64_t next_random(void);
+
+static struct oracle_move to_oracle(struct move move);
+
+/* finds every legal move the slow way: every from/to pair is tried with the
+ * oracle on a copy of the game. Returns the number of moves. */
+static int probe_moves(struct oracle_game *oracle, struct move *out);
+
+/* checks everything about `game` that the engine should agree with itself and
+ * with `oracle` on. Returns 0 if it does, otherwise -1 and a description in
+ * `report`. */
+static int check_position(struct game *game, struct oracle_game *oracle,
+		char report[REPORT_SIZE]);
+
+/* checks if two games are in the same position with the same clocks. struct
+ * board has padding, so it can't just be compared with memcmp(). */
+static bool same_position(struct game *a, struct game *b);
+
+/* checks if the oracle has the same pieces on the same squares and the same
+ * player to move */
+static bool same_placement(struct game *game, struct oracle_game *oracle);
+
+/* what make_move() should return for a legal move, going by what the oracle
+ * returned for it */
+static enum outcome find_outcome(int oracle_code);
+
+/* plays `moves` from `start_fen` and checks the resulting position. Returns
+ * true if that shows a divergence, false if it doesn't or if the moves can't
+ * be played anymore. */
+static bool reproduces(char *start_fen, struct move *moves, int move_count,
+		char report[REPORT_SIZE]);
+
+/* removes as many moves as possible while keeping the divergence, returns the
+ * new number of moves */
+static int minimize(char *start_fen, struct move *moves, int move_count);
+
+/* prints the divergence, the position it was found in and how to get there */
+static void print_divergence(char *start_fen, struct move *moves, int move_count,
+		char report[REPORT_SIZE]);
+
+static int run_fuzz(long games);
+static int run_throughput(long positions);
+
+static int compare_moves(const void *a, const void *b);
+static double get_seconds(void);
+static void print_help(char *progname);
+
+int main(int argc, char *argv[]) {
+	long games, positions;
+	uint64_t seed;
+
+	games = 100;
+	positions = -1;
+	seed = time(NULL);
+	for (;;) {
+		int opt = getopt(argc, argv, "hn:s:b:");
+		switch (opt) {
+		case -1:
+			goto got_args;
+		case 'n':
+			if ((games = atol(optarg)) <= 0) {
+				fprintf(stderr, "%s: invalid number of games\n", argv[0]);
+				return 1;
+			}
+			break;
+		case 's':
+			seed = strtoull(optarg, NULL, 10);
+			break;
+		case 'b':
+			if ((positions = atol(optarg)) <= 0) {
+				fprintf(stderr, "%s: invalid number of positions\n", argv[0]);
+				return 1;
+			}
+			break;
+		case 'h':
+			print_help(argv[0]);
+			return 0;
+		default:
+			print_help(argv[0]);
+			return 1;
+		}
+	}
+got_args:
+
+	printf("Seed %llu\n", (unsigned long long) seed);
+	/* xorshift gets stuck on 0 */
+	rng_state = seed * 0x9e3779b97f4a7c15 | 1;
+
+	if (positions > 0) {
+		return run_throughput(positions);
+	}
+	return run_fuzz(games);
+}
+
+static int run_fuzz(long games) {
+	static struct move moves[MAX_PLIES];
+	char report[REPORT_SIZE];
+	long positions, endings[3];
+	double start;
+
+	positions = 0;
+	memset(endings, 0, sizeof endings);
+	start = get_seconds();
+	for (long i = 0; i < games; ++i) {
+		char *start_fen;
+		struct game *game;
+		struct oracle_game oracle;
+		int move_count;
+
+		start_fen = start_fens[next_random() % START_COUNT];
+		if ((game = new_game()) == NULL || init_game(game, start_fen) != 0 ||
+		    oracle_init_game(&oracle, start_fen) != 0) {
+			fputs("Failed to set up a game\n", stderr);
+			return 1;
+		}
+
+		for (move_count = 0; move_count < MAX_PLIES; ++move_count) {
+			struct move legal[MAX_MOVES];
+			struct oracle_move oracle_move;
+			int legal_count, code;
+
+			++positions;
+			if (check_position(game, &oracle, report) != 0) {
+				printf("Divergence after %d moves of game %ld, minimizing...\n",
+						move_count, i + 1);
+				print_divergence(start_fen, moves, move_count, report);
+				move_count = minimize(start_fen, moves, move_count);
+				reproduces(start_fen, moves, move_count, report);
+				puts("\nMinimized:");
+				print_divergence(start_fen, moves, move_count, report);
+				free_game(game);
+				return 1;
+			}
+
+			if ((legal_count = generate_legal_moves(game, legal)) == 0) {
+				break;
+			}
+			moves[move_count] = legal[next_random() % legal_count];
+
+			oracle_move = to_oracle(moves[move_count]);
+			oracle_try_move(&oracle, &oracle_move);
+			code = make_move(game, &moves[move_count]);
+			if (code == WHITE_WIN || code == BLACK_WIN) {
+				++endings[CHECKMATE];
+			}
+			else if (code == FORCED_DRAW) {
+				++endings[STALEMATE];
+			}
+			if (code < 0) {
+				++move_count;
+				++positions;
+				if (check_position(game, &oracle, report) != 0) {
+					print_divergence(start_fen, moves, move_count, report);
+					free_game(game);
+					return 1;
+				}
+				break;
+			}
+		}
+		if (move_count >= MAX_PLIES) {
+			++endings[PLAYING];
+		}
+
+		free_game(game);
+	}
+
+	printf("%ld games, %ld positions in %.2fs, no divergences\n",
+			games, positions, get_seconds() - start);
+	printf("%ld ended in checkmate, %ld in a draw, %ld went on too long\n",
+			endings[CHECKMATE], endings[STALEMATE], endings[PLAYING]);
+	return 0;
+}
+
+static int run_throughput(long positions) {
+	struct sample *samples;
+	struct game *game;
+	struct oracle_game oracle;
+	double start, probe_time, generate_time;
+	long probe_moves_total, generate_moves_total;
+	long count;
+
+	if ((samples = malloc(positions * sizeof *samples)) == NULL) {
+		fputs("Failed to allocate memory\n", stderr);
+		return 1;
+	}
+
+	/* collect positions from random games */
+	count = 0;
+	game = NULL;
+	while (count < positions) {
+		struct move legal[MAX_MOVES];
+		struct oracle_move oracle_move;
+		int legal_count;
+
+		if (game == NULL) {
+			char *start_fen = start_fens[next_random() % START_COUNT];
+			if ((game = new_game()) == NULL || init_game(game, start_fen) != 0 ||
+			    oracle_init_game(&oracle, start_fen) != 0) {
+				fputs("Failed to set up a game\n", stderr);
+				return 1;
+			}
+		}
+
+		memcpy(&samples[count].game, game, sizeof *game);
+		samples[count].game.history = NULL;
+		samples[count++].oracle = oracle;
+
+		if ((legal_count = generate_legal_moves(game, legal)) == 0) {
+			free_game(game);
+			game = NULL;
+			continue;
+		}
+		legal[0] = legal[next_random() % legal_count];
+		oracle_move = to_oracle(legal[0]);
+		oracle_try_move(&oracle, &oracle_move);
+		if (make_move(game, &legal[0]) < 0) {
+			free_game(game);
+			game = NULL;
+		}
+	}
+	if (game != NULL) {
+		free_game(game);
+	}
+
+	/* the reference: find moves by probing the oracle, then play each on
+	 * a copy */
+	probe_moves_total = 0;
+	start = get_seconds();
+	for (long i = 0; i < positions; ++i) {
+		static struct move probed[MAX_PROBED];
+		int probed_count = probe_moves(&samples[i].oracle, probed);
+		for (int j = 0; j < probed_count; ++j) {
+			struct oracle_game copy = samples[i].oracle;
+			struct oracle_move move = to_oracle(probed[j]);
+			oracle_try_move(&copy, &move);
+		}
+		probe_moves_total += probed_count;
+	}
+	probe_time = get_seconds() - start;
+
+	/* the fast path: generate moves, then play each with do_move() */
+	generate_moves_total = 0;
+	start = get_seconds();
+	for (long i = 0; i < positions; ++i) {
+		struct move legal[MAX_MOVES];
+		int legal_count = generate_legal_moves(&samples[i].game, legal);
+		for (int j = 0; j < legal_count; ++j) {
+			struct undo undo;
+			do_move(&samples[i].game, &legal[j], &undo);
+			undo_move(&samples[i].game, &legal[j], &undo);
+		}
+		generate_moves_total += legal_count;
+	}
+	generate_time = get_seconds() - start;
+
+	if (probe_moves_total != generate_moves_total) {
+		printf("The paths found %ld and %ld moves, run without -b to find out why\n",
+				probe_moves_total, generate_moves_total);
+		free(samples);
+		return 1;
+	}
+
+	printf("%ld positions, %ld moves\n", positions, probe_moves_total);
+	printf("%-30s %10.0f positions/s %12.0f moves/s\n", "oracle probing",
+			positions / probe_time, probe_moves_total / probe_time);
+	printf("%-30s %10.0f positions/s %12.0f moves/s\n", "generator and do_move()",
+			positions / generate_time, generate_moves_total / generate_time);
+	printf("The generator is %.1fx faster\n", probe_time / generate_time);
+
+	free(samples);
+	return 0;
+}
+
+static uint64_t next_random(void) {
+	rng_state ^= rng_state << 13;
+	rng_state ^= rng_state >> 7;
+	rng_state ^= rng_state << 17;
+	return rng_state;
+}
+
+static struct oracle_move to_oracle(struct move move) {
+	struct oracle_move ret;
+	ret.r_i = SQUARE_ROW(move_from(move));
+	ret.c_i = SQUARE_COL(move_from(move));
+	ret.r_f = SQUARE_ROW(move_to(move));
+	ret.c_f = SQUARE_COL(move_to(move));
+	ret.promotion = move_promotion(move);
+	return ret;
+}
+
+static int probe_moves(struct oracle_game *oracle, struct move *out) {
+	int ret = 0;
+
+	for (int from = 0; from < 64; ++from) {
+		for (int to = 0; to < 64; ++to) {
+			struct move move = pack_move(from, to, EMPTY);
+			struct oracle_move probe = to_oracle(move);
+			struct oracle_game copy = *oracle;
+			int code;
+
+			code = oracle_try_move(&copy, &probe);
+			if (code != MISSING_PROMOTION) {
+				if (code != ILLEGAL_MOVE) {
+					out[ret++] = move;
+				}
+				continue;
+			}
+
+			for (enum piece_type type = ROOK; type <= QUEEN; ++type) {
+				move = pack_move(from, to, type);
+				probe = to_oracle(move);
+				copy = *oracle;
+				if (oracle_try_move(&copy, &probe) != ILLEGAL_MOVE) {
+					out[ret++] = move;
+				}
+			}
+		}
+	}
+
+	return ret;
+}
+
+static int check_position(struct game *game, struct oracle_game *oracle,
+		char report[REPORT_SIZE]) {
+	static struct move probed[MAX_PROBED];
+	struct move legal[MAX_MOVES];
+	char fen[FEN_SIZE], round_trip[FEN_SIZE];
+	struct game *parsed;
+	int legal_count, probed_count;
+
+	if (!same_placement(game, oracle)) {
+		snprintf(report, REPORT_SIZE, "the oracle's board is different");
+		return -1;
+	}
+
+	if (game->key != compute_key(game)) {
+		snprintf(report, REPORT_SIZE, "the incremental key is %016llx, should be %016llx",
+				(unsigned long long) game->key,
+				(unsigned long long) compute_key(game));
+		return -1;
+	}
+
+	/* the same set of legal moves */
+	legal_count = generate_legal_moves(game, legal);
+	probed_count = probe_moves(oracle, probed);
+	qsort(legal, legal_count, sizeof *legal, compare_moves);
+	qsort(probed, probed_count, sizeof *probed, compare_moves);
+	for (int i = 0, j = 0; i < legal_count || j < probed_count;) {
+		int cmp = i >= legal_count ? 1 :
+			j >= probed_count ? -1 :
+			compare_moves(&legal[i], &probed[j]);
+		char text[MOVE_STRING_SIZE];
+
+		if (cmp == 0) {
+			++i;
+			++j;
+			continue;
+		}
+
+		move_to_string(cmp < 0 ? &legal[i] : &probed[j], text);
+		snprintf(report, REPORT_SIZE, "%s is legal according to %s only", text,
+				cmp < 0 ? "the generator" : "the oracle");
+		return -1;
+	}
+
+	if (has_legal_move(game) != (legal_count > 0)) {
+		snprintf(report, REPORT_SIZE, "has_legal_move() says %d, there are %d moves",
+				has_legal_move(game), legal_count);
+		return -1;
+	}
+	if (has_check_evasion(game) != (legal_count > 0)) {
+		snprintf(report, REPORT_SIZE, "has_check_evasion() says %d, there are %d moves",
+				has_check_evasion(game), legal_count);
+		return -1;
+	}
+
+	/* the same targets for every square */
+	for (int sq = 0; sq < 64; ++sq) {
+		uint64_t targets = 0;
+		for (int i = 0; i < legal_count; ++i) {
+			if (move_from(legal[i]) == sq) {
+				targets |= SQUARE_BIT(move_to(legal[i]));
+			}
+		}
+		if (legal_moves_from(game, sq) != targets) {
+			snprintf(report, REPORT_SIZE, "legal_moves_from(%c%d) is %016llx, should be %016llx",
+					SQUARE_COL(sq) + 'a', 8 - SQUARE_ROW(sq),
+					(unsigned long long) legal_moves_from(game, sq),
+					(unsigned long long) targets);
+			return -1;
+		}
+	}
+
+	/* the same position and outcome after every move */
+	for (int i = 0; i < legal_count; ++i) {
+		struct game before, made;
+		struct oracle_game oracle_after;
+		struct oracle_move oracle_move;
+		struct undo undo;
+		enum outcome expected;
+		char text[MOVE_STRING_SIZE];
+		int code, oracle_code;
+
+		memcpy(&before, game, sizeof before);
+		memcpy(&made, game, sizeof made);
+		code = make_move(&made, &legal[i]);
+		do_move(game, &legal[i], &undo);
+		oracle_after = *oracle;
+		oracle_move = to_oracle(legal[i]);
+		oracle_code = oracle_make_move(&oracle_after, &oracle_move);
+		expected = find_outcome(oracle_code);
+
+		move_to_string(&legal[i], text);
+		if (!same_position(&made, game)) {
+			snprintf(report, REPORT_SIZE, "do_move() and make_move() disagree on %s", text);
+		}
+		else if (!same_placement(game, &oracle_after)) {
+			snprintf(report, REPORT_SIZE, "the oracle's board is different after %s", text);
+		}
+		else if (game->key != compute_key(game)) {
+			snprintf(report, REPORT_SIZE, "the key is wrong after %s", text);
+		}
+		/* a draw by rule can come before a checkmate */
+		else if (expected == CHECKMATE && code != oracle_code && code != FORCED_DRAW) {
+			snprintf(report, REPORT_SIZE, "%s is checkmate, make_move() returned %d", text, code);
+		}
+		else if (expected == STALEMATE && code != FORCED_DRAW) {
+			snprintf(report, REPORT_SIZE, "%s is stalemate, make_move() returned %d", text, code);
+		}
+		else if (expected == PLAYING && (code == WHITE_WIN || code == BLACK_WIN)) {
+			snprintf(report, REPORT_SIZE, "%s isn't checkmate, make_move() returned %d", text, code);
+		}
+		else {
+			undo_move(game, &legal[i], &undo);
+			if (memcmp(&before, game, sizeof before) != 0) {
+				snprintf(report, REPORT_SIZE, "undo_move() didn't take back %s", text);
+			}
+			else {
+				continue;
+			}
+		}
+		return -1;
+	}
+
+	/* FEN round trips */
+	write_fen(game, fen);
+	if ((parsed = new_game()) == NULL) {
+		snprintf(report, REPORT_SIZE, "out of memory");
+		return -1;
+	}
+	if (init_game(parsed, fen) != 0) {
+		snprintf(report, REPORT_SIZE, "init_game() rejected write_fen()'s \"%s\"", fen);
+		free_game(parsed);
+		return -1;
+	}
+	write_fen(parsed, round_trip);
+	if (!same_position(parsed, game)) {
+		snprintf(report, REPORT_SIZE, "\"%s\" sets up a different position", fen);
+		free_game(parsed);
+		return -1;
+	}
+	if (strcmp(fen, round_trip) != 0) {
+		snprintf(report, REPORT_SIZE, "\"%s\" was written back as \"%s\"", fen, round_trip);
+		free_game(parsed);
+		return -1;
+	}
+	free_game(parsed);
+
+	return 0;
+}
+
+static bool same_position(struct game *a, struct game *b) {
+	return memcmp(a->board.pieces, b->board.pieces, sizeof a->board.pieces) == 0 &&
+		memcmp(a->board.players, b->board.players, sizeof a->board.players) == 0 &&
+		memcmp(a->board.squares, b->board.squares, sizeof a->board.squares) == 0 &&
+		a->board.castling == b->board.castling &&
+		a->board.en_pessant == b->board.en_pessant &&
+		a->key == b->key && a->duration == b->duration &&
+		a->since_big_move == b->since_big_move;
+}
+
+static bool same_placement(struct game *game, struct oracle_game *oracle) {
+	if (get_player(game) != oracle_get_player(oracle)) {
+		return false;
+	}
+	for (int r = 0; r < 8; ++r) {
+		for (int c = 0; c < 8; ++c) {
+			struct oracle_piece *piece = &oracle->board[r][c];
+			unsigned int code = game->board.squares[SQUARE(r, c)];
+
+			if (piece->type == EMPTY ? code != EMPTY :
+					code != PIECE_CODE(piece->player, piece->type)) {
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+static enum outcome find_outcome(int oracle_code) {
+	switch (oracle_code) {
+	case WHITE_WIN: case BLACK_WIN:
+		return CHECKMATE;
+	case FORCED_DRAW:
+		return STALEMATE;
+	default:
+		return PLAYING;
+	}
+}
+
+static bool reproduces(char *start_fen, struct move *moves, int move_count,
+		char report[REPORT_SIZE]) {
+	struct game *game;
+	struct oracle_game oracle;
+	bool ret;
+
+	if ((game = new_game()) == NULL || init_game(game, start_fen) != 0 ||
+	    oracle_init_game(&oracle, start_fen) != 0) {
+		return false;
+	}
+
+	for (int i = 0; i < move_count; ++i) {
+		struct oracle_move oracle_move = to_oracle(moves[i]);
+		int code = make_move(game, &moves[i]);
+
+		oracle_try_move(&oracle, &oracle_move);
+		/* the game has to still be going after every move but the last */
+		if ((code < 0 && i < move_count - 1) || code == ILLEGAL_MOVE ||
+		    code == MISSING_PROMOTION) {
+			free_game(game);
+			return false;
+		}
+	}
+
+	ret = check_position(game, &oracle, report) != 0;
+	free_game(game);
+	return ret;
+}
+
+static int minimize(char *start_fen, struct move *moves, int move_count) {
+	static struct move attempt[MAX_PLIES];
+	char report[REPORT_SIZE];
+
+	/* try removing chunks of moves, halving the chunk size whenever
+	 * nothing can be removed */
+	for (int chunk = move_count / 2; chunk >= 1;) {
+		bool removed = false;
+
+		for (int i = 0; i + chunk <= move_count; ++i) {
+			int attempt_count = move_count - chunk;
+
+			memcpy(attempt, moves, i * sizeof *moves);
+			memcpy(attempt + i, moves + i + chunk,
+					(move_count - i - chunk) * sizeof *moves);
+			if (reproduces(start_fen, attempt, attempt_count, report)) {
+				memcpy(moves, attempt, attempt_count * sizeof *moves);
+				move_count = attempt_count;
+				removed = true;
+				--i;
+			}
+		}
+
+		if (!removed) {
+			chunk /= 2;
+		}
+		else if (chunk > move_count) {
+			chunk = move_count;
+		}
+	}
+
+	return move_count;
+}
+
+static void print_divergence(char *start_fen, struct move *moves, int move_count,
+		char report[REPORT_SIZE]) {
+	struct game *game;
+	char fen[FEN_SIZE];
+
+	printf("  %s\n", report);
+	printf("  start: %s\n", start_fen);
+	printf("  moves:");
+	for (int i = 0; i < move_count; ++i) {
+		char text[MOVE_STRING_SIZE];
+		printf(" %s", move_to_string(&moves[i], text));
+	}
+	putchar('\n');
+
+	if ((game = new_game()) == NULL || init_game(game, start_fen) != 0) {
+		return;
+	}
+	for (int i = 0; i < move_count; ++i) {
+		make_move(game, &moves[i]);
+	}
+	write_fen(game, fen);
+	printf("  position: %s\n", fen);
+	free_game(game);
+}
+
+static int compare_moves(const void *a, const void *b) {
+	const struct move *x = a, *y = b;
+	return (int) x->bits - (int) y->bits;
+}
+
+static double get_seconds(void) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+static void print_help(char *progname) {
+	printf("Usage: %s [-n games] [-s seed] [-b positions]\n", progname);
+	puts("Plays random games and compares the move generator, make_move() and");
+	puts("do_move() against the original 8x8 engine in every position.");
+	puts("  -h: Show this help and quit");
+	puts("  -n [games]: Play [games] games (default 100)");
+	puts("  -s [seed]: Seed the random number generator, the default is the time");
+	puts("  -b [positions]: Instead of comparing, time the oracle and the generator over");
+	puts("                  [positions] positions from random games");
+}
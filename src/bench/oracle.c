@@ -0,0 +1,728 @@
+/* chessh - chess over ssh
+ * Copyright (C) 2024  Nate Choe <nate@natechoe.dev>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * */
+/* the engine as it was before bitboards, with these changes:
+ *  - pawns are promoted when they move instead of while checking the move, so
+ *    checking for attacks no longer turns pawns into queens
+ *  - pawn and castling moves near the edge don't read outside the board
+ *  - kings only castle with their own rooks
+ *  - en pessant squares are read from FEN correctly, and only the pawn that
+ *    just moved can be taken en pessant
+ *  - the 50 move rule is gone, the engine has more draws than this ever did
+ *
+ * Keep it slow and obvious, it's only worth anything as long as it shares
+ * nothing with src/client/chess.c. */
+
+#include <ctype.h>
+#include <string.h>
+#include <stdlib.h>
+#include <assert.h>
+
+#include <sys/param.h>
+
+#include <util.h>
+#include <bench/oracle.h>
+
+/* precondition: game, move, captured, castle are all valid pointers
+ * precondition: *captured == NULL
+ * precondition: castle->r_i == castle->r_f == castle->c_i == castle->c_f == -1
+ * returns: the corresponding `PIECE_is_illegal` function's return value
+ * postcondition: *captured MAY be set to some extra casualty of this move, such
+ *                as a pawn taken by en pessant (holy hell)
+ * postcondition: *castle MAY be set to some move that also happens, probably
+ *                due to castling.
+ * XXX: This function does not account for checks */
+static int is_illegal(struct oracle_game *game, struct oracle_move *move,
+		struct oracle_piece **captured, struct oracle_move *castle, enum player player);
+
+/* precondition: game, move, captured, and castle are all valid pointers
+ *               *captured == *castle = NULL
+ * precondition: the moving piece and the destination are owned by different
+ *               players
+ * precondition: the moving piece is actually of the specified type
+ * precondition: `move` doesn't start and end at the same spot
+ * returns: <0 if a move made by this type of piece is illegal
+ * postcondition: see `is_illegal` */
+static int rook_is_illegal(struct oracle_game *game, struct oracle_move *move,
+		struct oracle_piece **captured, struct oracle_move *castle);
+static int knight_is_illegal(struct oracle_game *game, struct oracle_move *move,
+		struct oracle_piece **captured, struct oracle_move *castle);
+static int bishop_is_illegal(struct oracle_game *game, struct oracle_move *move,
+		struct oracle_piece **captured, struct oracle_move *castle);
+static int queen_is_illegal(struct oracle_game *game, struct oracle_move *move,
+		struct oracle_piece **captured, struct oracle_move *castle);
+static int king_is_illegal(struct oracle_game *game, struct oracle_move *move,
+		struct oracle_piece **captured, struct oracle_move *castle);
+static int pawn_is_illegal(struct oracle_game *game, struct oracle_move *move,
+		struct oracle_piece **captured, struct oracle_move *castle);
+
+/* does `move`, completely unchecked. captures `captured`, possibly advances the
+ * clock */
+static void move_unchecked(struct oracle_game *game, struct oracle_move *move,
+		struct oracle_piece *captured, bool should_advance_clock);
+
+/* checks if game->board[r][c] is attacked by the person playing AGAINST
+ * player. This means that if `player` is WHITE, then `piece_is_attacked` would
+ * check if BLACK is attacking a certain tile. */
+static bool piece_is_attacked(struct oracle_game *game, int r, int c, enum player player);
+
+/* checks if `player` is in check */
+static bool is_in_check(struct oracle_game *game, enum player player);
+
+/* checks if `player` has a valid move to make */
+static bool can_make_move(struct oracle_game *game, enum player player);
+
+/* checks if the piece at [row][col] can make a move */
+static bool piece_can_move(struct oracle_game *game, int row, int col);
+
+/* like oracle_try_move(), but on a copy of the game */
+static inline int make_move_dryrun(struct oracle_game *game, struct oracle_move *move) {
+	struct oracle_game scratch;
+	memcpy(&scratch, game, sizeof scratch);
+	return oracle_try_move(&scratch, move);
+}
+
+/* returns -1 on error */
+static int parse_int(char *s, int start, int *end);
+
+#define PARSE_MOVE(game, move, src, dst) \
+	do { \
+		src = &game->board[move->r_i][move->c_i]; \
+		dst = &game->board[move->r_f][move->c_f]; \
+	} while (0)
+
+int oracle_make_move(struct oracle_game *game, struct oracle_move *move) {
+	int error_code;
+	enum player curr_player, other_player;
+
+	curr_player = oracle_get_player(game);
+	other_player = curr_player == WHITE ? BLACK : WHITE;
+
+	error_code = oracle_try_move(game, move);
+
+	switch (error_code) {
+	case NONFATAL_ERROR:
+		return error_code;
+	}
+
+	if (!can_make_move(game, other_player)) {
+		if (is_in_check(game, other_player)) {
+			return curr_player == WHITE ?  WHITE_WIN : BLACK_WIN;
+		}
+		return FORCED_DRAW;
+	}
+
+	return error_code;
+}
+
+int oracle_try_move(struct oracle_game *game, struct oracle_move *move) {
+	struct oracle_piece *captured;
+	struct oracle_move castle;
+	int error_code;
+	struct oracle_game backup;
+	enum player curr_player;
+
+	curr_player = oracle_get_player(game);
+
+	captured = NULL;
+	castle.r_i = castle.r_f = castle.c_i = castle.c_f = -1;
+	castle.promotion = EMPTY;
+
+	if ((error_code = is_illegal(game, move, &captured, &castle, curr_player)) < 0) {
+		return error_code;
+	}
+
+	memcpy(&backup, game, sizeof backup);
+
+	move_unchecked(game, move, captured, true);
+	if (castle.r_i != -1) {
+		move_unchecked(game, &castle, NULL, false);
+	}
+
+	if (is_in_check(game, curr_player)) {
+		memcpy(game, &backup, sizeof *game);
+		return ILLEGAL_MOVE;
+	}
+
+	return error_code;
+}
+
+static int is_illegal(struct oracle_game *game, struct oracle_move *move,
+		struct oracle_piece **captured, struct oracle_move *castle, enum player player) {
+	struct oracle_piece *piece, *dst;
+
+	/* reject out-of-bounds moves */
+	if (is_oob(move->r_i, 0, 8) || is_oob(move->c_i, 0, 8) ||
+	    is_oob(move->r_f, 0, 8) || is_oob(move->c_f, 0, 8)) {
+		return ILLEGAL_MOVE;
+	}
+
+	PARSE_MOVE(game, move, piece, dst);
+
+	/* reject out of sequence moves */
+	if (piece->type == EMPTY || piece->player != player) {
+		return ILLEGAL_MOVE;
+	}
+
+	/* reject moves where white takes white or black takes black */
+	/* this also rejects noop moves like h4h4 */
+	if (dst->type != EMPTY && dst->player == piece->player) {
+		return ILLEGAL_MOVE;
+	}
+
+	switch (piece->type) {
+	case ROOK:
+		return rook_is_illegal(game, move, captured, castle);
+	case KNIGHT:
+		return knight_is_illegal(game, move, captured, castle);
+	case BISHOP:
+		return bishop_is_illegal(game, move, captured, castle);
+	case QUEEN:
+		return queen_is_illegal(game, move, captured, castle);
+	case KING:
+		return king_is_illegal(game, move, captured, castle);
+	case PAWN:
+		return pawn_is_illegal(game, move, captured, castle);
+	case EMPTY:
+		assert(false);
+		return ILLEGAL_MOVE;
+	}
+
+	return ILLEGAL_MOVE;
+}
+
+static int rook_is_illegal(struct oracle_game *game, struct oracle_move *move,
+		struct oracle_piece **captured, struct oracle_move *castle) {
+	int min, max;
+
+	UNUSED(captured);
+	UNUSED(castle);
+
+	if ((move->r_i - move->r_f) * (move->c_i - move->c_f) != 0) {
+		return ILLEGAL_MOVE;
+	}
+
+	min = MIN(move->r_i, move->r_f);
+	max = MAX(move->r_i, move->r_f);
+	for (int i = min+1; i < max; ++i) {
+		if (game->board[i][move->c_i].type != EMPTY) {
+			return ILLEGAL_MOVE;
+		}
+	}
+
+	min = MIN(move->c_i, move->c_f);
+	max = MAX(move->c_i, move->c_f);
+	for (int i = min+1; i < max; ++i) {
+		if (game->board[move->r_i][i].type != EMPTY) {
+			return ILLEGAL_MOVE;
+		}
+	}
+
+	return 0;
+}
+
+static int knight_is_illegal(struct oracle_game *game, struct oracle_move *move,
+		struct oracle_piece **captured, struct oracle_move *castle) {
+	int dr, dc;
+
+	UNUSED(game);
+	UNUSED(captured);
+	UNUSED(castle);
+
+	dr = abs(move->r_f - move->r_i);
+	dc = abs(move->c_f - move->c_i);
+
+	return (MIN(dr, dc) == 1 && MAX(dr, dc) == 2) ? 0 : ILLEGAL_MOVE;
+}
+
+static int bishop_is_illegal(struct oracle_game *game, struct oracle_move *move,
+		struct oracle_piece **captured, struct oracle_move *castle) {
+	int dr, dc, cr, cc;
+
+	UNUSED(captured);
+	UNUSED(castle);
+
+	dr = move->r_f - move->r_i;
+	dc = move->c_f - move->c_i;
+	if (abs(dr) != abs(dc)) {
+		return ILLEGAL_MOVE;
+	}
+
+	cr = (dr < 0) ? -1 : 1;
+	cc = (dc < 0) ? -1 : 1;
+
+	int r = move->r_i + cr;
+	int c = move->c_i + cc;
+	while (r != move->r_f) {
+		if (game->board[r][c].type != EMPTY) {
+			return ILLEGAL_MOVE;
+		}
+		r += cr;
+		c += cc;
+	}
+	return 0;
+}
+
+static int queen_is_illegal(struct oracle_game *game, struct oracle_move *move,
+		struct oracle_piece **captured, struct oracle_move *castle) {
+	int dr, dc;
+
+	dr = abs(move->r_f - move->r_i);
+	dc = abs(move->c_f - move->c_i);
+	if (dr * dc == 0) {
+		return rook_is_illegal(game, move, captured, castle);
+	}
+	if (dr == dc) {
+		return bishop_is_illegal(game, move, captured, castle);
+	}
+	return ILLEGAL_MOVE;
+}
+
+static int king_is_illegal(struct oracle_game *game, struct oracle_move *move,
+		struct oracle_piece **captured, struct oracle_move *castle) {
+	int dr, dc;
+	int cc;
+	int c;
+	struct oracle_piece *piece, *rook;
+
+	UNUSED(captured);
+
+	dr = move->r_f - move->r_i;
+	dc = move->c_f - move->c_i;
+
+	/* regular king moves */
+
+	if (abs(dr) <= 1 && abs(dc) <= 1) {
+		return 0;
+	}
+
+	/* castling */
+
+	piece = &game->board[move->r_i][move->c_i];
+
+	/* the king has already moved or this would be an improper castle */
+	if (piece->moves != 0 ||
+	    dr != 0 ||
+	    abs(dc) != 2) {
+		return ILLEGAL_MOVE;
+	}
+
+	cc = (dc < 0) ? -1:1;
+
+	/* find the next piece (presumably a rook) that goes in the proper
+	 * direction */
+	for (c = move->c_i + cc;
+			0 <= c &&
+			c < 8 &&
+			game->board[move->r_i][c].type == EMPTY;
+			c += cc) ;
+
+	/* there is no piece */
+	if (c < 0 || c >= 8) {
+		return ILLEGAL_MOVE;
+	}
+
+	rook = &game->board[move->r_i][c];
+
+	/* the next piece in the proper direction isn't a rook */
+	if (rook->type != ROOK || rook->player != piece->player) {
+		return ILLEGAL_MOVE;
+	}
+	/* the rook has already moved */
+	if (rook->moves != 0) {
+		return ILLEGAL_MOVE;
+	}
+
+	/* we're under attack*/
+	if (piece_is_attacked(game, move->r_i, move->c_i, piece->player) ||
+	    piece_is_attacked(game, move->r_i, move->c_i + cc, piece->player) ||
+	    piece_is_attacked(game, move->r_i, move->c_i + cc*2, piece->player)) {
+		return ILLEGAL_MOVE;
+	}
+
+	castle->r_i = castle->r_f = move->r_i;
+	castle->c_i = c;
+	castle->c_f = move->c_i + cc;
+
+	return 0;
+}
+
+static int pawn_is_illegal(struct oracle_game *game, struct oracle_move *move,
+		struct oracle_piece **captured, struct oracle_move *castle) {
+	struct oracle_piece *piece, *dst;
+	int direction;
+
+	UNUSED(castle);
+
+	PARSE_MOVE(game, move, piece, dst);
+
+	direction = piece->player == WHITE ? -1 : 1;
+
+	/* Regular moves where pawns don't capture */
+	if (move->c_f == move->c_i) {
+		if (dst->type != EMPTY) {
+			return ILLEGAL_MOVE;
+		}
+		if (move->r_i + direction == move->r_f) {
+			goto promote_pawn;
+		}
+		if (move->r_i + direction*2 == move->r_f &&
+		    game->board[move->r_i+direction][move->c_i].type == EMPTY &&
+		    piece->moves == 0) {
+			goto promote_pawn;
+		}
+
+		return ILLEGAL_MOVE;
+	}
+
+	/* Pawn capture moves */
+	if (abs(move->c_f - move->c_i) == 1) {
+		struct oracle_piece *pessant;
+
+		if (move->r_i + direction != move->r_f) {
+			return ILLEGAL_MOVE;
+		}
+
+		pessant = &game->board[move->r_i][move->c_f];
+		if (dst->type != EMPTY) {
+			goto promote_pawn;
+		}
+
+		/* en pessant */
+
+		if (pessant->type == PAWN &&
+		    pessant->player != piece->player &&
+		    pessant->moves == 1 &&
+		    ((piece->player == WHITE && move->r_i == 3) ||
+		     (piece->player == BLACK && move->r_i == 4)) &&
+		    pessant->last_move == game->duration) {
+			*captured = pessant;
+			goto promote_pawn;
+		}
+		return ILLEGAL_MOVE;
+	}
+
+	return ILLEGAL_MOVE;
+promote_pawn:
+
+	if ((piece->player == WHITE && move->r_f == 0) ||
+	    (piece->player == BLACK && move->r_f == 7)) {
+		switch (move->promotion) {
+		case ROOK: case KNIGHT: case BISHOP: case QUEEN:
+			break;
+		default:
+			return MISSING_PROMOTION;
+		}
+	}
+	return 0;
+}
+
+static void move_unchecked(struct oracle_game *game, struct oracle_move *move,
+		struct oracle_piece *captured, bool should_advance_clock) {
+	struct oracle_piece *src, *dst;
+
+	PARSE_MOVE(game, move, src, dst);
+	if (should_advance_clock) {
+		++game->duration;
+	}
+	if (captured != NULL) {
+		captured->type = EMPTY;
+	}
+	memcpy(dst, src, sizeof *dst);
+	++dst->moves;
+	dst->last_move = game->duration;
+	if (dst->type == PAWN && (move->r_f == 0 || move->r_f == 7)) {
+		dst->type = move->promotion;
+	}
+	src->type = EMPTY;
+}
+
+static bool piece_is_attacked(struct oracle_game *game, int r, int c, enum player player) {
+	enum player other_player = player == WHITE ? BLACK : WHITE;
+	bool ret = false;
+	struct oracle_piece old;
+	old = game->board[r][c];
+
+	/* If a pawn attacks an empty piece, `is_illegal` will think that that
+	 * empty space is safe, even though a piece that moves there is
+	 * attacked. */
+	if (old.type == EMPTY) {
+		game->board[r][c].type = PAWN;
+		game->board[r][c].player = player;
+	}
+	for (int i = 0; i < 8; ++i) {
+		for (int j = 0; j < 8; ++j) {
+			struct oracle_move move;
+			struct oracle_piece *captured;
+			struct oracle_move castle;
+
+			if (game->board[i][j].type == EMPTY ||
+			    game->board[i][j].player == player) {
+				continue;
+			}
+
+			captured = NULL;
+			castle.r_i = castle.c_i = castle.r_f = castle.c_f = -1;
+			move.r_i = i;
+			move.c_i = j;
+			move.r_f = r;
+			move.c_f = c;
+			move.promotion = QUEEN;
+			if (is_illegal(game, &move, &captured, &castle, other_player) >= 0) {
+				ret = true;
+				goto end;
+			}
+		}
+	}
+	ret = false;
+end:
+	game->board[r][c] = old;
+	return ret;
+}
+
+static bool is_in_check(struct oracle_game *game, enum player player) {
+	int kr, kc;
+	for (kr = 0; kr < 8; ++kr) {
+		for (kc = 0; kc < 8; ++kc) {
+			if (game->board[kr][kc].type == KING &&
+			    game->board[kr][kc].player == player) {
+				goto found_king;
+			}
+		}
+	}
+	/* somehow the king is gone? */
+	return true;
+found_king:
+	return piece_is_attacked(game, kr, kc, player);
+}
+
+static bool can_make_move(struct oracle_game *game, enum player player) {
+	for (int i = 0; i < 8; ++i) {
+		for (int j = 0; j < 8; ++j){
+			if (game->board[i][j].type == EMPTY ||
+			    game->board[i][j].player != player) {
+				continue;
+			}
+			if (piece_can_move(game, i, j)) {
+				return true;
+			}
+		}
+	}
+	return false;
+}
+
+static bool piece_can_move(struct oracle_game *game, int row, int col) {
+	for (int i = 0; i < 8; ++i) {
+		for (int j = 0; j < 8; ++j) {
+			struct oracle_move move;
+			move.r_i = row;
+			move.c_i = col;
+			move.r_f = i;
+			move.c_f = j;
+			move.promotion = QUEEN;
+			if (make_move_dryrun(game, &move) >= 0) {
+				return true;
+			}
+		}
+	}
+	return false;
+}
+
+enum player oracle_get_player(struct oracle_game *game) {
+	return game->duration % 2 == 0 ? WHITE : BLACK;
+}
+
+int oracle_init_game(struct oracle_game *game, char *state) {
+	int r, c, i, duration;
+
+	r = c = 0;
+	for (i = 0; state[i] != ' '; ++i) {
+		if (r >= 8 || (c >= 8 && state[i] != '/')) {
+			return -1;
+		}
+		switch (tolower(state[i])) {
+		case '/':
+			if (c != 8) {
+				return -1;
+			}
+			++r;
+			c = 0;
+			continue;
+		case 'r':
+			game->board[r][c].type = ROOK;
+			goto finish_generic;
+		case 'n':
+			game->board[r][c].type = KNIGHT;
+			goto finish_generic;
+		case 'b':
+			game->board[r][c].type = BISHOP;
+			goto finish_generic;
+		case 'q':
+			game->board[r][c].type = QUEEN;
+			goto finish_generic;
+		case 'k':
+			game->board[r][c].type = KING;
+			game->board[r][c].moves = 0;
+			goto finish_special;
+		case 'p':
+			game->board[r][c].type = PAWN;
+			game->board[r][c].moves = islower(state[i]) ?
+				(r == 1 ? 0:1) :
+				(r == 6 ? 0:1);
+			goto finish_special;
+		finish_generic:
+			game->board[r][c].moves = 1;
+			/* fallthrough */
+		finish_special:
+			game->board[r][c].player = islower(state[i]) ? BLACK : WHITE;
+			/* nothing has just moved */
+			game->board[r][c].last_move = -1;
+			++c;
+			break;
+		digit:
+			for (int o = 0; o < state[i] - '0'; ++o) {
+				if (c >= 8) {
+					return -1;
+				}
+				game->board[r][c++].type = EMPTY;
+			}
+			break;
+		default:
+			if (isdigit(state[i])) {
+				goto digit;
+			}
+			return -1;
+		}
+	}
+
+	if (r != 7 || c != 8) {
+		return -1;
+	}
+
+	switch (state[++i]) {
+	case 'w':
+		game->duration = 0;
+		break;
+	case 'b':
+		game->duration = 1;
+		break;
+	default:
+		return -1;
+	}
+
+	if (state[++i] != ' ') {
+		return -1;
+	}
+
+	for (;;) {
+		char c = state[++i];
+		switch (c) {
+#define ROOK_CASTLE(ch, r, c, p) \
+		case ch: \
+			if (game->board[r][c].type != ROOK || \
+			    game->board[r][c].player != p) { \
+				return -1; \
+			} \
+			game->board[r][c].moves = 0; \
+			break
+		ROOK_CASTLE('K', 7, 7, WHITE);
+		ROOK_CASTLE('Q', 7, 0, WHITE);
+		ROOK_CASTLE('k', 0, 7, BLACK);
+		ROOK_CASTLE('q', 0, 0, BLACK);
+#undef ROOK_CASTLE
+		case '-':
+			if (state[++i] != ' ') {
+				return -1;
+			}
+			/* fallthrough */
+		case ' ':
+			goto got_castles;
+		default:
+			return -1;
+		}
+	}
+got_castles:
+
+	/* We're reusing variable names! [r, c] is now the location of the en
+	 * pessant pawn */
+	r = c = -1;
+	if (state[++i] != '-') {
+		if (state[i] < 'a' || state[i] > 'h') {
+			return -1;
+		}
+		c = state[i] - 'a';
+
+		/* the pawn is one row past the square it skipped */
+		switch (state[++i]) {
+		case '3': r = 4; break;
+		case '6': r = 3; break;
+		default: return -1;
+		}
+	}
+
+	switch (state[++i]) {
+	case ' ':
+		break;
+	case '\0':
+		duration = 0;
+		goto got_clock;
+	default:
+		return -1;
+	}
+
+	/* the halfmove clock, there's no 50 move rule here */
+	if (parse_int(state, ++i, &i) == -1) {
+		return -1;
+	}
+
+	if (state[i++] != ' ') {
+		return -1;
+	}
+
+	if ((duration = parse_int(state, i, &i)-1) < 0) {
+		return -1;
+	}
+	duration *= 2;
+
+got_clock:
+	game->duration += duration;
+	if (r != -1) {
+		if (game->board[r][c].type != PAWN) {
+			return -1;
+		}
+		game->board[r][c].last_move = game->duration;
+	}
+
+	if (state[i] != '\0') {
+		return -1;
+	}
+
+	return 0;
+}
+
+static int parse_int(char *s, int start, int *end) {
+	int i, ret;
+	ret = 0;
+	if (!isdigit(s[start])) {
+		return -1;
+	}
+	for (i = start; isdigit(s[i]); ++i) {
+		ret *= 10;
+		ret += s[i] - '0';
+	}
+	*end = i;
+	return ret;
+}
@@ -21,6 +21,7 @@
 #include <stdint.h>
 
 #include <util.h>
+#include <client/api.h>
 #include <client/chess.h>
 #include <client/frontend.h>
 
@@ -51,31 +52,38 @@
 #define CMD_NOTIFY 0x07
 #define CMD_REGISTER 0x08
 #define CMD_AUTH_RESPONSE 0x09
+#define CMD_GET_VALID_MOVES_FROM 0x0a
+#define CMD_MOVE_BITMAP 0x0b
 
-static char *get_move(void *aux, struct game *game, enum player player);
+static int get_move(void *aux, struct game *game, enum player player,
+		struct move *move);
 static void report_error(void *aux, int code);
 static void report_event(int code, void *aux, struct game *game, void *data);
 static void report_msg(void *aux, int msg_code);
 static void display_board(void *aux, struct game *game, enum player player);
 static int api_get_move();
-static void api_send_board(struct game *game);
-static int count_valid_moves(struct game *game, char *buff, int buff_size);
 static void print_move(struct move *move);
 static void write_move(char buff[2], struct move *move);
-static bool move_is_valid(struct game *game, struct move *move);
-static void putword(uint16_t word);
 
+/* the frontend comes first, so free() gets the cache too */
+struct api_frontend {
+	struct frontend frontend;
+	struct move_cache cache;
+};
+
+/* the board's mailbox already uses the API's piece encoding */
 static inline int get_code(struct game *game, int r, int c) {
-	struct piece *piece = &game->board.board[r][c];
-	return piece->player << 3 | piece->type;
+	return game->board.squares[SQUARE(r, c)];
 }
 
 struct frontend *new_api_frontend(void) {
+	struct api_frontend *storage;
 	struct frontend *ret;
 
-	if ((ret = malloc(sizeof *ret)) == NULL) {
+	if ((storage = malloc(sizeof *storage)) == NULL) {
 		return NULL;
 	}
+	ret = &storage->frontend;
 
 	ret->get_move = get_move;
 	ret->report_error = report_error;
@@ -83,49 +91,42 @@ struct frontend *new_api_frontend(void) {
 	ret->report_event = report_event;
 	ret->display_board = display_board;
 	ret->free = (void (*)(struct frontend *)) free;
-	ret->aux = NULL;
+	ret->aux = &storage->cache;
+	storage->cache.valid = false;
 
 	return ret;
 }
 
-static char *get_move(void *aux, struct game *game, enum player player) {
-	struct move move;
-
-	UNUSED(aux);
+static int get_move(void *aux, struct game *game, enum player player,
+		struct move *move) {
 	UNUSED(player);
 
 	NOTIFY(your_turn);
 	for (;;) {
-		int cmd;
-		char move_buff[1024];
-		int move_count;
+		int cmd, sq;
 		cmd = getchar();
 		switch (cmd) {
 		case CMD_MAKE_MOVE:
-			if (api_get_move(&move) < 0) {
-				return NULL;
-			}
-			goto got_move;
+			return api_get_move(move);
 		case CMD_GET_BOARD:
 			putchar(CMD_BOARD_INFO);
 			api_send_board(game);
 			fflush(stdout);
 			break;
 		case CMD_GET_VALID_MOVES:
-			putchar(CMD_MOVE_INFO);
-			move_count = count_valid_moves(game, move_buff, sizeof move_buff);
-			putword(move_count);
-			fwrite(move_buff, move_count * 2, 1, stdout);
-			fflush(stdout);
+			api_send_valid_moves(aux, game);
+			break;
+		case CMD_GET_VALID_MOVES_FROM:
+			if ((sq = getchar()) == EOF) {
+				return -1;
+			}
+			/* a position only has 6 bits */
+			api_send_moves_from(game, sq & 0x3f);
 			break;
 		default:
-			return NULL;
+			return -1;
 		}
 	}
-
-got_move:
-
-	return move_to_string(&move);
 }
 
 static void report_error(void *aux, int code) {
@@ -163,6 +164,9 @@ static void report_msg(void *aux, int msg_code) {
 	case MSG_FORCED_DRAW:
 		NOTIFY(forced_draw);
 		break;
+	case MSG_DRAW_OFFER:
+		NOTIFY(draw_offer);
+		break;
 	case MSG_WAITING_FOR_MOVE:
 	/* this is handled by get_move() */
 		break;
@@ -196,20 +200,15 @@ static int api_get_move(struct move *ret) {
 	if (c1 == EOF || c2 == EOF) {
 		return -1;
 	}
-	ret->r_i = (c1 >> 5) & 7;
-	ret->c_i = (c1 >> 2) & 7;
-	ret->r_f = (c2 >> 5) & 7;
-	ret->c_f = (c2 >> 2) & 7;
-	if (c1 & 2) {
-		ret->promotion = c2 & 3;
-	}
-	else {
-		ret->promotion = EMPTY;
-	}
+	/* the wire format is the packed move, give or take bits that the
+	 * client shouldn't have set */
+	ret->bits = (uint16_t) (c1 << 8 | c2);
+	ret->bits &= (ret->bits & MOVE_HAS_PROMOTION) ?
+		MOVE_SQUARES | MOVE_HAS_PROMOTION | 3 : MOVE_SQUARES;
 	return 0;
 }
 
-static void api_send_board(struct game *game) {
+void api_send_board(struct game *game) {
 	for (int r = 0; r < 8; ++r) {
 		for (int c = 0; c < 8; c += 2) {
 			int code;
@@ -221,32 +220,53 @@ static void api_send_board(struct game *game) {
 	fflush(stdout);
 }
 
-static int count_valid_moves(struct game *game, char *buff, int buff_size) {
+int count_valid_moves(struct game *game, char *buff, int buff_size) {
+	struct move moves[MAX_MOVES];
+	int move_count;
 	int ret = 0;
-	for (int r_i = 0; r_i < 8; ++r_i) {
-		for (int c_i = 0; c_i < 8; ++c_i) {
-			for (int r_f = 0; r_f < 8; ++r_f) {
-				for (int c_f = 0; c_f < 8; ++c_f) {
-					struct move move;
-					move.r_i = r_i;
-					move.c_i = c_i;
-					move.r_f = r_f;
-					move.c_f = c_f;
-					if (move_is_valid(game, &move)) {
-						if (ret * 2 >= buff_size) {
-							goto end;
-						}
-						write_move(buff + ret*2, &move);
-						++ret;
-					}
-				}
-			}
+
+	move_count = generate_legal_moves(game, moves);
+	for (int i = 0; i < move_count; ++i) {
+		/* moves sent by the server never contain a promotion, so only
+		 * list each promoting move once */
+		if (move_promotion(moves[i]) != EMPTY && move_promotion(moves[i]) != QUEEN) {
+			continue;
 		}
+		if (ret * 2 >= buff_size) {
+			break;
+		}
+		write_move(buff + ret*2, &moves[i]);
+		++ret;
 	}
-end:
 	return ret;
 }
 
+void api_send_valid_moves(struct move_cache *cache, struct game *game) {
+	if (!cache->valid || cache->key != game->key || cache->duration != game->duration) {
+		int move_count = count_valid_moves(game, cache->reply + 3,
+				sizeof cache->reply - 3);
+		cache->reply[0] = CMD_MOVE_INFO;
+		cache->reply[1] = (char) (move_count >> 8);
+		cache->reply[2] = (char) move_count;
+		cache->length = 3 + move_count*2;
+		cache->key = game->key;
+		cache->duration = game->duration;
+		cache->valid = true;
+	}
+	fwrite(cache->reply, cache->length, 1, stdout);
+	fflush(stdout);
+}
+
+void api_send_moves_from(struct game *game, int sq) {
+	uint64_t targets = legal_moves_from(game, sq);
+	putchar(CMD_MOVE_BITMAP);
+	putchar(sq);
+	for (int shift = 56; shift >= 0; shift -= 8) {
+		putchar((int) (targets >> shift & 0xff));
+	}
+	fflush(stdout);
+}
+
 static void print_move(struct move *move) {
 	char buff[2];
 	write_move(buff, move);
@@ -255,19 +275,7 @@ static void print_move(struct move *move) {
 }
 
 static void write_move(char buff[2], struct move *move) {
-	buff[0] = (char) (move->r_i << 5 | move->c_i << 2);
-	buff[1] = (char) (move->r_f << 5 | move->c_f << 2);
-}
-
-static bool move_is_valid(struct game *game, struct move *move) {
-	struct game backup;
-	memcpy(&backup, game, sizeof backup);
-	return make_move(&backup, move) != ILLEGAL_MOVE;
-}
-
-static void putword(uint16_t word) {
-	int c1 = (word >> 8) & 0xff;
-	int c2 = (word)      & 0xff;
-	putchar(c1);
-	putchar(c2);
+	uint16_t bits = move->bits & MOVE_SQUARES;
+	buff[0] = (char) (bits >> 8);
+	buff[1] = (char) bits;
 }
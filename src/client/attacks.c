@@ -0,0 +1,279 @@
+/* chessh - chess over ssh
+ * Copyright (C) 2024  Nate Choe <nate@natechoe.dev>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * */
+
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdlib.h>
+
+#include <util.h>
+#include <client/chess.h>
+#include <client/attacks.h>
+
+uint64_t knight_attacks[64];
+uint64_t king_attacks[64];
+uint64_t pawn_attacks[2][64];
+uint64_t between_squares[64][64];
+uint64_t line_through[64][64];
+
+struct magic rook_magics[64];
+struct magic bishop_magics[64];
+
+/* A rook can have up to 12 relevant blockers, a bishop up to 9. These are the
+ * sums of 2^(relevant blockers) over every square. */
+static uint64_t rook_table[102400];
+static uint64_t bishop_table[5248];
+
+#ifdef HAVE_PEXT
+/* the same sizes work for PEXT, which also needs 2^(relevant blockers)
+ * entries per square */
+static uint64_t rook_pext_table[102400];
+static uint64_t bishop_pext_table[5248];
+#endif
+
+/* Found offline by trying random sparse numbers until there were no harmful
+ * collisions. */
+static const uint64_t rook_magic_numbers[64] = {
+	0x1080004008801020ULL, 0x0840092002c03000ULL, 0x1900200010400900ULL,
+	0x0880100008000480ULL, 0x4200100420080200ULL, 0x8100020100080400ULL,
+	0x0200040110886200ULL, 0x0200008040220411ULL, 0x0404800084400220ULL,
+	0x0000401000402000ULL, 0x0086001081220440ULL, 0x0408800800100280ULL,
+	0x000a001201040820ULL, 0x8848800200840080ULL, 0x4001000100040200ULL,
+	0x0442000102105084ULL, 0x9080010020804100ULL, 0x0040404000201009ULL,
+	0x0000808010002009ULL, 0x2200090021d00100ULL, 0x0008008008040080ULL,
+	0x0004004002010040ULL, 0x0011040008015042ULL, 0x00000a0001768104ULL,
+	0x0000800080204009ULL, 0x2010004140002001ULL, 0x9800200280100080ULL,
+	0x1000100080080080ULL, 0x0442000a00049020ULL, 0x2100040080020080ULL,
+	0x0800120400900148ULL, 0x0010040a00128541ULL, 0x2800804000800030ULL,
+	0x1010002000400041ULL, 0x4000200011004100ULL, 0x0610008410800800ULL,
+	0x0400802402800800ULL, 0xc100020080800400ULL, 0x0002000802000401ULL,
+	0x0182085882000401ULL, 0x0220204000808000ULL, 0x2860100040024022ULL,
+	0x0001002004110040ULL, 0x99101042000a0020ULL, 0x0004080004008080ULL,
+	0x0010040002008080ULL, 0x2012004881020004ULL, 0x8300842444820011ULL,
+	0x0088403882010200ULL, 0x0820400080210100ULL, 0x0110910040a00300ULL,
+	0x0801100280080480ULL, 0x0242009008200600ULL, 0x1002000489500200ULL,
+	0x0040800200010080ULL, 0x0091800041000080ULL, 0x0000209300488001ULL,
+	0x04c1002414824001ULL, 0x020020000b001041ULL, 0x7000100004200901ULL,
+	0x8002002004100802ULL, 0x30010002084c0007ULL, 0x0888221800813004ULL,
+	0x4000002840840112ULL
+};
+
+static const uint64_t bishop_magic_numbers[64] = {
+	0xa010041108003100ULL, 0x006082020a002900ULL, 0x6810010619200000ULL,
+	0x08281a0520000408ULL, 0x0001104001000400ULL, 0x0018901008048400ULL,
+	0x00040a0210245280ULL, 0x000200210808a402ULL, 0x9140048410821200ULL,
+	0x0800091010820041ULL, 0x20504804832202c0ULL, 0x0100091401081000ULL,
+	0x8021011140000012ULL, 0x0810020804450400ULL, 0x208b0542109008a2ULL,
+	0x0080084a08040204ULL, 0x0040e2a80811244cULL, 0x2505022008008108ULL,
+	0x0430220100420040ULL, 0x010a040420220040ULL, 0x1105000290400000ULL,
+	0x0093001200822120ULL, 0x4000a62048043004ULL, 0x280120048a015004ULL,
+	0x006090002a020814ULL, 0x44042000240800d0ULL, 0x01102800040a4400ULL,
+	0x1004080080220040ULL, 0x0001001011004024ULL, 0x0010044000805040ULL,
+	0x0914041200820100ULL, 0x0004821012821480ULL, 0x0024040500c05021ULL,
+	0x0088611002080200ULL, 0x0116080a00040020ULL, 0x4000020080080080ULL,
+	0x2450450140840040ULL, 0x0000880201484100ULL, 0x0222020404020092ULL,
+	0x8081110600002e00ULL, 0x2842101105000801ULL, 0x1100809008001025ULL,
+	0x00020202221c0400ULL, 0x0422014022009020ULL, 0x0210046102100c00ULL,
+	0xc004008082029102ULL, 0x00aa461801101200ULL, 0x0404080080201108ULL,
+	0x020542108c205002ULL, 0x0410544804100100ULL, 0x0040910841100000ULL,
+	0x0400200042021100ULL, 0x00004204850400c0ULL, 0x0200100410a42102ULL,
+	0x1040020801210102ULL, 0x0805040410420000ULL, 0x2884804130100200ULL,
+	0x800c262201242000ULL, 0x1058000194108800ULL, 0x0014221054420204ULL,
+	0x0104000012a02200ULL, 0x0200881003300100ULL, 0x0140400202840100ULL,
+	0x0402020801010201ULL
+};
+
+static const int rook_directions[4][2] = {
+	{-1, 0}, {1, 0}, {0, -1}, {0, 1}
+};
+static const int bishop_directions[4][2] = {
+	{-1, -1}, {-1, 1}, {1, -1}, {1, 1}
+};
+
+/* fills every table, runs before main() */
+static void init_attacks(void) __attribute__((constructor));
+
+/* every square a single step away from `sq` in any of `count` directions */
+static uint64_t step_attacks(int sq, const int (*steps)[2], int count);
+
+/* slides from `sq` in every direction until a blocker or the edge of the board.
+ * Only used to fill the tables. */
+static uint64_t slide_attacks(int sq, uint64_t occupied, const int (*directions)[2]);
+
+/* `pext_table` can be NULL. Aborts if one of the magic numbers sends two
+ * subsets with different attacks to the same slot. */
+static void init_magics(struct magic *magics, const uint64_t *numbers, uint64_t *table,
+		uint64_t *pext_table, const int (*directions)[2]);
+
+static void init_lines(void);
+
+static void init_attacks(void) {
+	static const int knight_steps[8][2] = {
+		{-2, -1}, {-2, 1}, {-1, -2}, {-1, 2},
+		{1, -2}, {1, 2}, {2, -1}, {2, 1}
+	};
+	static const int king_steps[8][2] = {
+		{-1, -1}, {-1, 0}, {-1, 1}, {0, -1},
+		{0, 1}, {1, -1}, {1, 0}, {1, 1}
+	};
+	static const int white_pawn_steps[2][2] = { {-1, -1}, {-1, 1} };
+	static const int black_pawn_steps[2][2] = { {1, -1}, {1, 1} };
+
+	for (int sq = 0; sq < 64; ++sq) {
+		knight_attacks[sq] = step_attacks(sq, knight_steps, 8);
+		king_attacks[sq] = step_attacks(sq, king_steps, 8);
+		pawn_attacks[WHITE][sq] = step_attacks(sq, white_pawn_steps, 2);
+		pawn_attacks[BLACK][sq] = step_attacks(sq, black_pawn_steps, 2);
+	}
+
+#ifdef HAVE_PEXT
+	if (cpu_has_fast_pext()) {
+		init_magics(rook_magics, rook_magic_numbers, rook_table,
+				rook_pext_table, rook_directions);
+		init_magics(bishop_magics, bishop_magic_numbers, bishop_table,
+				bishop_pext_table, bishop_directions);
+	}
+	else
+#endif
+	{
+		init_magics(rook_magics, rook_magic_numbers, rook_table,
+				NULL, rook_directions);
+		init_magics(bishop_magics, bishop_magic_numbers, bishop_table,
+				NULL, bishop_directions);
+	}
+	init_lines();
+}
+
+static uint64_t step_attacks(int sq, const int (*steps)[2], int count) {
+	uint64_t ret = 0;
+	for (int i = 0; i < count; ++i) {
+		int r = SQUARE_ROW(sq) + steps[i][0];
+		int c = SQUARE_COL(sq) + steps[i][1];
+		if (is_in_bounds(r, 0, 8) && is_in_bounds(c, 0, 8)) {
+			ret |= SQUARE_BIT(SQUARE(r, c));
+		}
+	}
+	return ret;
+}
+
+static uint64_t slide_attacks(int sq, uint64_t occupied, const int (*directions)[2]) {
+	uint64_t ret = 0;
+	for (int i = 0; i < 4; ++i) {
+		int dr = directions[i][0];
+		int dc = directions[i][1];
+		int r = SQUARE_ROW(sq) + dr;
+		int c = SQUARE_COL(sq) + dc;
+		while (is_in_bounds(r, 0, 8) && is_in_bounds(c, 0, 8)) {
+			ret |= SQUARE_BIT(SQUARE(r, c));
+			if (occupied & SQUARE_BIT(SQUARE(r, c))) {
+				break;
+			}
+			r += dr;
+			c += dc;
+		}
+	}
+	return ret;
+}
+
+static void init_magics(struct magic *magics, const uint64_t *numbers, uint64_t *table,
+		uint64_t *pext_table, const int (*directions)[2]) {
+	const uint64_t rows_edge = 0xff000000000000ffULL;
+	const uint64_t cols_edge = 0x8181818181818181ULL;
+
+	for (int sq = 0; sq < 64; ++sq) {
+		struct magic *magic = &magics[sq];
+		uint64_t edges, blockers, index;
+
+		/* a piece on the edge of the board is never blocked by
+		 * anything past it, and the edges never block anything */
+		edges = (rows_edge & ~(0xffULL << (SQUARE_ROW(sq) * 8))) |
+			(cols_edge & ~(0x0101010101010101ULL << SQUARE_COL(sq)));
+
+		magic->mask = slide_attacks(sq, 0, directions) & ~edges;
+		magic->magic = numbers[sq];
+		magic->shift = 64 - __builtin_popcountll(magic->mask);
+		magic->attacks = table;
+		magic->pext_attacks = pext_table;
+
+		/* go through every subset of the mask. They come up in the
+		 * same order as their PEXT indices. */
+		blockers = 0;
+		index = 0;
+		do {
+			uint64_t attacks = slide_attacks(sq, blockers, directions);
+			uint64_t *slot = &magic->attacks[(blockers * magic->magic) >> magic->shift];
+
+			/* a slider always attacks something, so an empty slot
+			 * is 0 */
+			if (*slot != 0 && *slot != attacks) {
+				fprintf(stderr, "The magic number for square %d has a harmful collision\n", sq);
+				abort();
+			}
+			*slot = attacks;
+			if (pext_table != NULL) {
+				magic->pext_attacks[index++] = attacks;
+			}
+			blockers = (blockers - magic->mask) & magic->mask;
+		} while (blockers != 0);
+
+		table += (uint64_t) 1 << (64 - magic->shift);
+		if (pext_table != NULL) {
+			pext_table += (uint64_t) 1 << (64 - magic->shift);
+		}
+	}
+}
+
+#ifdef HAVE_PEXT
+bool cpu_has_fast_pext(void) {
+	/* this can run before the constructor that normally does this */
+	__builtin_cpu_init();
+	/* AMD's PEXT was microcoded and far slower than a multiplication until
+	 * Zen 3 */
+	return __builtin_cpu_supports("popcnt") && __builtin_cpu_supports("bmi") &&
+		__builtin_cpu_supports("bmi2") &&
+		!__builtin_cpu_is("znver1") && !__builtin_cpu_is("znver2");
+}
+#endif
+
+static void init_lines(void) {
+	for (int a = 0; a < 64; ++a) {
+		for (int b = 0; b < 64; ++b) {
+			const int (*directions)[2];
+			uint64_t a_bit, b_bit;
+
+			a_bit = SQUARE_BIT(a);
+			b_bit = SQUARE_BIT(b);
+			if (a == b) {
+				continue;
+			}
+			else if (slide_attacks(a, 0, rook_directions) & b_bit) {
+				directions = rook_directions;
+			}
+			else if (slide_attacks(a, 0, bishop_directions) & b_bit) {
+				directions = bishop_directions;
+			}
+			else {
+				continue;
+			}
+
+			between_squares[a][b] = slide_attacks(a, b_bit, directions) &
+				slide_attacks(b, a_bit, directions);
+			line_through[a][b] = (slide_attacks(a, 0, directions) &
+				slide_attacks(b, 0, directions)) | a_bit | b_bit;
+		}
+	}
+}
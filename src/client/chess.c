@@ -15,6 +15,7 @@
  * along with this program.  If not, see <https://www.gnu.org/licenses/>.
  * */
 
+#include <stdio.h>
 #include <ctype.h>
 #include <string.h>
 #include <stdlib.h>
@@ -24,113 +25,221 @@
 
 #include <util.h>
 #include <client/chess.h>
+#include <client/attacks.h>
 
 /* precondition: game, move, captured, castle are all valid pointers
- * precondition: *captured == NULL
- * precondition: (*castle)->r_i == (*castle)->r_f ==
- *               (*castle)->c_i == * (*castle)->c_f == -1
+ * precondition: *captured == -1
+ * precondition: castle->bits == NO_MOVE
  * returns: the corresponding `PIECE_is_illegal` function's return value
- * postcondition: *captured MAY be set to some extra casualty of this move, such
- *                as a pawn taken by en pessant (holy hell)
+ * postcondition: *captured MAY be set to the square of some extra casualty of
+ *                this move, such as a pawn taken by en pessant (holy hell)
  * postcondition: *castle MAY be set to some move that also happens, probably
  *                due to castling.
  * XXX: This function does not account for checks */
-static int is_illegal(struct game *game, struct move *move, struct piece **captured, struct move *castle, enum player player);
+static int is_illegal(struct game *game, struct move *move, int *captured, struct move *castle, enum player player);
 
 /* precondition: game, move, captured, and castle are all valid pointers
- *               *captured == *castle = NULL
+ *               *captured == -1
  * precondition: the moving piece and the destination are owned by different
  *               players
  * precondition: the moving piece is actually of the specified type
  * precondition: `move` doesn't start and end at the same spot
  * returns: <0 if a move made by this type of piece is illegal
  * postcondition: see `is_illegal` */
-static int rook_is_illegal(struct game *game, struct move *move, struct piece **captured, struct move *castle);
-static int knight_is_illegal(struct game *game, struct move *move, struct piece **captured, struct move *castle);
-static int bishop_is_illegal(struct game *game, struct move *move, struct piece **captured, struct move *castle);
-static int queen_is_illegal(struct game *game, struct move *move, struct piece **captured, struct move *castle);
-static int king_is_illegal(struct game *game, struct move *move, struct piece **captured, struct move *castle);
-static int pawn_is_illegal(struct game *game, struct move *move, struct piece **captured, struct move *castle);
-
-/* does `move`, completely unchecked. captures `captured`, possibly advances the
- * clock */
-static void move_unchecked(struct game *game, struct move *move, struct piece *captured, bool should_advance_clock);
-
-/* checks if game->board.board[r][c] is attacked by the person playing AGAINST
+static int rook_is_illegal(struct game *game, struct move *move, int *captured, struct move *castle);
+static int knight_is_illegal(struct game *game, struct move *move, int *captured, struct move *castle);
+static int bishop_is_illegal(struct game *game, struct move *move, int *captured, struct move *castle);
+static int queen_is_illegal(struct game *game, struct move *move, int *captured, struct move *castle);
+static int king_is_illegal(struct game *game, struct move *move, int *captured, struct move *castle);
+static int pawn_is_illegal(struct game *game, struct move *move, int *captured, struct move *castle);
+
+/* does `move`, completely unchecked. captures the piece on the square
+ * `captured` (if it isn't -1), possibly advances the clock. Pawns that reach the
+ * last row become the move's promotion. */
+static void move_unchecked(struct game *game, struct move *move, int captured, bool should_advance_clock);
+
+/* places a piece on an empty square */
+static void put_piece(struct board *board, int sq, enum player player, enum piece_type type);
+
+/* removes whatever is on a square, if anything */
+static void clear_square(struct board *board, int sq);
+
+static void clear_board(struct board *board);
+
+/* random numbers for Zobrist hashing, see compute_key() */
+static uint64_t piece_keys[16][64];
+static uint64_t castling_keys[16];
+static uint64_t en_pessant_keys[8];
+static uint64_t black_to_move_key;
+
+static void init_keys(void) __attribute__((constructor));
+
+/* the part of the key that doesn't come from piece placement or the player to
+ * move, meaning castling rights and en pessant */
+static uint64_t state_key(struct board *board);
+
+/* the castling rights that are lost when anything moves to or from `sq` */
+static int castling_lost(int sq);
+
+/* checks if the opponent could legally take `player`'s pawn en pessant on
+ * `sq`, so not with a pinned pawn or one that leaves its king in check. The
+ * square is only kept when they could, like FIDE's rules for repeated
+ * positions. */
+static bool en_pessant_possible(struct board *board, int sq, enum player player);
+
+static inline uint64_t occupied(struct board *board) {
+	return board->players[WHITE] | board->players[BLACK];
+}
+
+static inline bool square_is_empty(struct game *game, int r, int c) {
+	return (occupied(&game->board) & SQUARE_BIT(SQUARE(r, c))) == 0;
+}
+
+/* checks if the square at [r][c] is attacked by the person playing AGAINST
  * player. This means that if `player` is WHITE, then `piece_is_attacked` would
  * check if BLACK is attacking a certain tile.
- * XXX: this function breaks with en pessant */
+ * XXX: this function ignores en pessant, which can never capture a king */
 static bool piece_is_attacked(struct game *game, int r, int c, enum player player);
 
-/* checks if `player` is in check */
-static bool is_in_check(struct game *game, enum player player);
+/* Functions marked FOR_PLAYER take the player they work for as an argument,
+ * and the move generator only ever calls them with a constant. Since they're
+ * always inlined, that gives the generator a copy of itself for each player
+ * where every direction, row and mask that depends on the player is worked out
+ * at compile time. `pext` works the same way, choosing between the magic and
+ * PEXT slider lookups (see attacks.h). */
+#define FOR_PLAYER static inline __attribute__((always_inline))
 
-/* checks if `player` has a valid move to make */
-static bool can_make_move(struct game *game, enum player player);
+#define OTHER_PLAYER(player) ((player) == WHITE ? BLACK : WHITE)
 
-/* checks if the piece at [row][col] can make a move */
-static bool piece_can_move(struct game *game, int row, int col);
+/* moves every bit in `bb` one row forwards from `player`'s point of view */
+#define FORWARD(player, bb) ((player) == WHITE ? (bb) >> 8 : (bb) << 8)
 
-/* like make_move, but doesn't account for checkmate */
-static int make_move_no_checkmate(struct game *game, struct move *move);
+#define HOME_ROW(player) ((player) == WHITE ? 7 : 0)
+#define PAWN_ROW(player) ((player) == WHITE ? 6 : 1)
+#define PROMOTION_ROW(player) ((player) == WHITE ? 0 : 7)
 
-/* like is_illegal, but accounts for checks*/
-static inline int make_move_dryrun(struct game *game, struct move *move) {
-	struct game scratch;
-	memcpy(&scratch, game, sizeof scratch);
-	return make_move_no_checkmate(&scratch, move);
-}
+/* returns every piece owned by `player` that attacks `sq`, pretending that
+ * the occupied squares are `all` */
+FOR_PLAYER uint64_t attackers(struct board *board, int sq, enum player player, bool pext,
+		uint64_t all);
+
+/* saves the current position into the game's history, returns the number of
+ * times it has come up (including this one) */
+static int record_position(struct game *game);
+
+/* checks if neither player has enough pieces left to ever checkmate */
+static bool is_insufficient_material(struct game *game);
+
+/* checks if `player` is in check */
+static bool is_in_check(struct game *game, enum player player);
+
+/* returns every square the piece on `sq` might be able to move to. This is a
+ * superset of the legal moves, it doesn't account for checks or for most of the
+ * rules of castling. */
+FOR_PLAYER uint64_t candidate_targets(struct game *game, enum player player, bool pext, int sq);
+
+/* like make_move, but doesn't account for checkmate. on success, `undo` can be
+ * used to take the move back. */
+static int make_move_no_checkmate(struct game *game, struct move *move, struct undo *undo);
+
+/* plays `move` along with its extra capture and castle (see `is_illegal`),
+ * saving whatever undo_move() needs into `undo` */
+static void apply_move(struct game *game, struct move *move, int captured, struct move *castle, struct undo *undo);
+
+/* checks if `move`, which must already be known to be legal apart from
+ * checks, leaves the moving player's king safe */
+static bool leaves_king_safe(struct game *game, struct move *move);
+
+/* everything about the king of the player to move that decides which of
+ * their moves are legal */
+struct king_safety {
+	int king; /* the king's square */
+	uint64_t checkers; /* the pieces giving check */
+	uint64_t pinned; /* friendly pieces that can only move towards or away
+			    from the king */
+	uint64_t evasions; /* every square that a piece other than the king can
+			      move to without leaving the king in check */
+};
+
+/* returns false if `player`, who must be on move, doesn't have a king */
+FOR_PLAYER bool find_king_safety(struct game *game, enum player player, bool pext,
+		struct king_safety *ret);
+
+/* like candidate_targets, but only returns legal moves */
+FOR_PLAYER uint64_t legal_targets(struct game *game, enum player player, bool pext,
+		struct king_safety *safety, int sq);
+
+/* the bodies of generate_legal_moves() and has_legal_move(), which call them
+ * with a constant player and `pext`. With HAVE_PEXT, those are picked when the
+ * program starts: either generic versions or versions compiled for BMI2, which
+ * also get POPCNT and TZCNT for free. */
+FOR_PLAYER int generate_moves(struct game *game, enum player player, bool pext, struct move *out);
+FOR_PLAYER bool find_legal_move(struct game *game, enum player player, bool pext);
+/* the body of legal_moves_from(), the same way */
+FOR_PLAYER uint64_t find_targets_from(struct game *game, enum player player, bool pext, int sq);
 
 /* returns -1 on error */
 static int parse_int(char *s, int start, int *end);
 
 #define PARSE_MOVE(game, move, src, dst) \
 	do { \
-		src = &game->board.board[move->r_i][move->c_i]; \
-		dst = &game->board.board[move->r_f][move->c_f]; \
+		src = game->board.squares[move_from(*move)]; \
+		dst = game->board.squares[move_to(*move)]; \
 	} while (0)
 
+/* the rows and columns of the squares a move goes between */
+#define FROM_ROW(move) SQUARE_ROW(move_from(*(move)))
+#define FROM_COL(move) SQUARE_COL(move_from(*(move)))
+#define TO_ROW(move) SQUARE_ROW(move_to(*(move)))
+#define TO_COL(move) SQUARE_COL(move_to(*(move)))
+
+/* a8a8, which can never be played, for when there's no castle */
+#define NO_MOVE 0
+
 struct game *new_game(void) {
-	struct game *ret;
-	if ((ret = malloc(sizeof *ret)) == NULL) {
+	struct game_storage *storage;
+	/* the game comes first in its storage, so free() gets both */
+	if ((storage = malloc(sizeof *storage)) == NULL) {
 		return NULL;
 	}
+	return init_game_storage(storage);
+}
 
-	ret->duration = 0;
-	ret->last_big_move = 0;
+struct game *init_game_storage(struct game_storage *storage) {
+	struct game *ret = &storage->game;
 
-	for (int i = 0; i < 8; ++i) {
-		for (int j = 0; j < 8; ++j) {
-			ret->board.board[i][j].moves = 0;
-			ret->board.board[i][j].type = EMPTY;
-		}
-	}
+	ret->history = &storage->history;
 
-	for (int i = 0; i < 2; ++i) {
-		for (int j = 0; j < 8; ++j) {
-			ret->board.board[i][j].player = BLACK;
-			ret->board.board[7-i][j].player = WHITE;
-		}
-	}
+	ret->duration = 0;
+	ret->since_big_move = 0;
+
+	clear_board(&ret->board);
 
 	for (int i = 0; i < 8; ++i) {
-		ret->board.board[1][i].type = PAWN;
-		ret->board.board[6][i].type = PAWN;
+		put_piece(&ret->board, SQUARE(1, i), BLACK, PAWN);
+		put_piece(&ret->board, SQUARE(6, i), WHITE, PAWN);
 	}
 
 #define FIRST_ROW_PIECE(index, ptype) \
-	ret->board.board[0][index].type = ptype; \
-	ret->board.board[0][7-index].type = ptype; \
-	ret->board.board[7][index].type = ptype; \
-	ret->board.board[7][7-index].type = ptype;
+	put_piece(&ret->board, SQUARE(0, index), BLACK, ptype); \
+	put_piece(&ret->board, SQUARE(0, 7-index), BLACK, ptype); \
+	put_piece(&ret->board, SQUARE(7, index), WHITE, ptype); \
+	put_piece(&ret->board, SQUARE(7, 7-index), WHITE, ptype);
 	FIRST_ROW_PIECE(0, ROOK);
 	FIRST_ROW_PIECE(1, KNIGHT);
 	FIRST_ROW_PIECE(2, BISHOP);
 #undef FIRST_ROW_PIECE
-	ret->board.board[0][3].type = QUEEN;
-	ret->board.board[0][4].type = KING;
-	ret->board.board[7][3].type = QUEEN;
-	ret->board.board[7][4].type = KING;
+	put_piece(&ret->board, SQUARE(0, 3), BLACK, QUEEN);
+	put_piece(&ret->board, SQUARE(0, 4), BLACK, KING);
+	put_piece(&ret->board, SQUARE(7, 3), WHITE, QUEEN);
+	put_piece(&ret->board, SQUARE(7, 4), WHITE, KING);
+
+	ret->board.castling = CASTLE_WHITE_KINGSIDE | CASTLE_WHITE_QUEENSIDE |
+		CASTLE_BLACK_KINGSIDE | CASTLE_BLACK_QUEENSIDE;
+	ret->key = compute_key(ret);
+
+	ret->history->start = 0;
+	record_position(ret);
 
 	return ret;
 }
@@ -141,90 +250,167 @@ void free_game(struct game *game) {
 
 int make_move(struct game *game, struct move *move) {
 	int error_code;
+	struct undo undo;
+	int repetitions;
 	enum player curr_player, other_player;
 
 	curr_player = get_player(game);
 	other_player = curr_player == WHITE ? BLACK : WHITE;
 
-	error_code = make_move_no_checkmate(game, move);
+	error_code = make_move_no_checkmate(game, move, &undo);
 
 	switch (error_code) {
 	case NONFATAL_ERROR:
 		return error_code;
 	}
 
-	if (game->duration - game->last_big_move >= 150) {
-		return FORCED_DRAW;
-	}
+	repetitions = record_position(game);
 
-	if (game->duration - game->last_big_move >= 100) {
-		return DRAW_OFFER;
+	if (game->since_big_move >= 150 || repetitions >= 5 ||
+	    is_insufficient_material(game)) {
+		return FORCED_DRAW;
 	}
 
-	if (!can_make_move(game, other_player)) {
+	/* a mate on the 50th move still counts */
+	if (!has_legal_move(game)) {
 		if (is_in_check(game, other_player)) {
 			return curr_player == WHITE ?  WHITE_WIN : BLACK_WIN;
 		}
 		return FORCED_DRAW;
 	}
 
+	if (game->since_big_move >= 100 || repetitions >= 3) {
+		return DRAW_OFFER;
+	}
+
 	return error_code;
 }
 
-static int make_move_no_checkmate(struct game *game, struct move *move) {
-	struct piece *captured;
+static int make_move_no_checkmate(struct game *game, struct move *move, struct undo *undo) {
+	int captured;
 	struct move castle;
 	int error_code;
-	struct game backup;
 	enum player curr_player;
 
 	curr_player = get_player(game);
 
-	captured = NULL;
-	castle.r_i = castle.r_f = castle.c_i = castle.c_f = -1;
+	captured = -1;
+	castle.bits = NO_MOVE;
 
 	if ((error_code = is_illegal(game, move, &captured, &castle, curr_player)) < 0) {
 		return error_code;
 	}
 
-	memcpy(&backup, game, sizeof backup);
-
-	move_unchecked(game, move, captured, true);
-	if (castle.r_i != -1) {
-		move_unchecked(game, &castle, NULL, false);
-	}
+	apply_move(game, move, captured, &castle, undo);
 
 	if (is_in_check(game, curr_player)) {
-		memcpy(game, &backup, sizeof *game);
+		undo_move(game, move, undo);
 		return ILLEGAL_MOVE;
 	}
 
 	return error_code;
 }
 
-static int is_illegal(struct game *game, struct move *move, struct piece **captured, struct move *castle, enum player player) {
-	struct piece *piece, *dst;
+void do_move(struct game *game, struct move *move, struct undo *undo) {
+	int captured;
+	struct move castle;
+	enum piece_type type;
 
-	/* reject out-of-bounds moves */
-	if (is_oob(move->r_i, 0, 8) || is_oob(move->c_i, 0, 8) ||
-	    is_oob(move->r_f, 0, 8) || is_oob(move->c_f, 0, 8)) {
-		return ILLEGAL_MOVE;
+	captured = -1;
+	castle.bits = NO_MOVE;
+	type = get_piece_type(game, FROM_ROW(move), FROM_COL(move));
+
+	/* a pawn moving diagonally onto an empty square is en pessant */
+	if (type == PAWN && FROM_COL(move) != TO_COL(move) &&
+	    square_is_empty(game, TO_ROW(move), TO_COL(move))) {
+		captured = SQUARE(FROM_ROW(move), TO_COL(move));
+	}
+
+	/* a king moving two squares is a castle */
+	if (type == KING && abs(TO_COL(move) - FROM_COL(move)) == 2) {
+		int cc = TO_COL(move) < FROM_COL(move) ? -1 : 1;
+		castle = pack_move(SQUARE(FROM_ROW(move), cc < 0 ? 0 : 7),
+				move_from(*move) + cc, EMPTY);
+	}
+
+	apply_move(game, move, captured, &castle, undo);
+}
+
+void undo_move(struct game *game, struct move *move, struct undo *undo) {
+	struct board *board = &game->board;
+	int src, dst;
+
+	src = move_from(*move);
+	dst = move_to(*move);
+
+	if (undo->castle_from != -1) {
+		clear_square(board, undo->castle_to);
+		put_piece(board, undo->castle_from, CODE_PLAYER(undo->piece), ROOK);
+	}
+
+	clear_square(board, dst);
+	put_piece(board, src, CODE_PLAYER(undo->piece), CODE_TYPE(undo->piece));
+	if (CODE_TYPE(undo->captured) != EMPTY) {
+		put_piece(board, undo->captured_square,
+				CODE_PLAYER(undo->captured), CODE_TYPE(undo->captured));
+	}
+
+	board->castling = undo->castling;
+	board->en_pessant = undo->en_pessant;
+	game->since_big_move = undo->since_big_move;
+	game->key = undo->key;
+	--game->duration;
+}
+
+static void apply_move(struct game *game, struct move *move, int captured, struct move *castle, struct undo *undo) {
+	struct board *board = &game->board;
+
+	undo->castling = board->castling;
+	undo->en_pessant = board->en_pessant;
+	undo->since_big_move = game->since_big_move;
+	undo->piece = board->squares[move_from(*move)];
+	undo->captured_square = captured != -1 ? captured : move_to(*move);
+	undo->captured = board->squares[undo->captured_square];
+	undo->castle_from = undo->castle_to = -1;
+	undo->key = game->key;
+
+	move_unchecked(game, move, captured, true);
+	if (castle->bits != NO_MOVE) {
+		undo->castle_from = move_from(*castle);
+		undo->castle_to = move_to(*castle);
+		move_unchecked(game, castle, -1, false);
 	}
+}
+
+static bool leaves_king_safe(struct game *game, struct move *move) {
+	struct undo undo;
+	enum player player;
+	bool ret;
+
+	player = get_player(game);
+	do_move(game, move, &undo);
+	ret = !is_in_check(game, player);
+	undo_move(game, move, &undo);
+	return ret;
+}
+
+static int is_illegal(struct game *game, struct move *move, int *captured, struct move *castle, enum player player) {
+	uint8_t piece, dst;
 
 	PARSE_MOVE(game, move, piece, dst);
 
 	/* reject out of sequence moves */
-	if (piece->type == EMPTY || piece->player != player) {
+	if (CODE_TYPE(piece) == EMPTY || CODE_PLAYER(piece) != player) {
 		return ILLEGAL_MOVE;
 	}
 
 	/* reject moves where white takes white or black takes black */
 	/* this also rejects noop moves like h4h4 */
-	if (dst->type != EMPTY && dst->player == piece->player) {
+	if (CODE_TYPE(dst) != EMPTY && CODE_PLAYER(dst) == player) {
 		return ILLEGAL_MOVE;
 	}
 
-	switch (piece->type) {
+	switch (CODE_TYPE(piece)) {
 	case ROOK:
 		return rook_is_illegal(game, move, captured, castle);
 	case KNIGHT:
@@ -245,28 +431,28 @@ static int is_illegal(struct game *game, struct move *move, struct piece **captu
 	return ILLEGAL_MOVE;
 }
 
-static int rook_is_illegal(struct game *game, struct move *move, struct piece **captured, struct move *castle) {
+static int rook_is_illegal(struct game *game, struct move *move, int *captured, struct move *castle) {
 	int min, max;
 
 	UNUSED(captured);
 	UNUSED(castle);
 
-	if ((move->r_i - move->r_f) * (move->c_i - move->c_f) != 0) {
+	if ((FROM_ROW(move) - TO_ROW(move)) * (FROM_COL(move) - TO_COL(move)) != 0) {
 		return ILLEGAL_MOVE;
 	}
 
-	min = MIN(move->r_i, move->r_f);
-	max = MAX(move->r_i, move->r_f);
+	min = MIN(FROM_ROW(move), TO_ROW(move));
+	max = MAX(FROM_ROW(move), TO_ROW(move));
 	for (int i = min+1; i < max; ++i) {
-		if (game->board.board[i][move->c_i].type != EMPTY) {
+		if (!square_is_empty(game, i, FROM_COL(move))) {
 			return ILLEGAL_MOVE;
 		}
 	}
 
-	min = MIN(move->c_i, move->c_f);
-	max = MAX(move->c_i, move->c_f);
+	min = MIN(FROM_COL(move), TO_COL(move));
+	max = MAX(FROM_COL(move), TO_COL(move));
 	for (int i = min+1; i < max; ++i) {
-		if (game->board.board[move->r_i][i].type != EMPTY) {
+		if (!square_is_empty(game, FROM_ROW(move), i)) {
 			return ILLEGAL_MOVE;
 		}
 	}
@@ -274,27 +460,27 @@ static int rook_is_illegal(struct game *game, struct move *move, struct piece **
 	return 0;
 }
 
-static int knight_is_illegal(struct game *game, struct move *move, struct piece **captured, struct move *castle) {
+static int knight_is_illegal(struct game *game, struct move *move, int *captured, struct move *castle) {
 	int dr, dc;
 
 	UNUSED(game);
 	UNUSED(captured);
 	UNUSED(castle);
 
-	dr = abs(move->r_f - move->r_i);
-	dc = abs(move->c_f - move->c_i);
+	dr = abs(TO_ROW(move) - FROM_ROW(move));
+	dc = abs(TO_COL(move) - FROM_COL(move));
 
 	return (MIN(dr, dc) == 1 && MAX(dr, dc) == 2) ? 0 : ILLEGAL_MOVE;
 }
 
-static int bishop_is_illegal(struct game *game, struct move *move, struct piece **captured, struct move *castle) {
+static int bishop_is_illegal(struct game *game, struct move *move, int *captured, struct move *castle) {
 	int dr, dc, cr, cc;
 
 	UNUSED(captured);
 	UNUSED(castle);
 
-	dr = move->r_f - move->r_i;
-	dc = move->c_f - move->c_i;
+	dr = TO_ROW(move) - FROM_ROW(move);
+	dc = TO_COL(move) - FROM_COL(move);
 	if (abs(dr) != abs(dc)) {
 		return ILLEGAL_MOVE;
 	}
@@ -302,10 +488,10 @@ static int bishop_is_illegal(struct game *game, struct move *move, struct piece
 	cr = (dr < 0) ? -1 : 1;
 	cc = (dc < 0) ? -1 : 1;
 
-	int r = move->r_i + cr;
-	int c = move->c_i + cc;
-	while (r != move->r_f) {
-		if (game->board.board[r][c].type != EMPTY) {
+	int r = FROM_ROW(move) + cr;
+	int c = FROM_COL(move) + cc;
+	while (r != TO_ROW(move)) {
+		if (!square_is_empty(game, r, c)) {
 			return ILLEGAL_MOVE;
 		}
 		r += cr;
@@ -314,13 +500,13 @@ static int bishop_is_illegal(struct game *game, struct move *move, struct piece
 	return 0;
 }
 
-static int queen_is_illegal(struct game *game, struct move *move, struct piece **captured, struct move *castle) {
+static int queen_is_illegal(struct game *game, struct move *move, int *captured, struct move *castle) {
 	int dr, dc;
 
 	UNUSED(castle);
 
-	dr = abs(move->r_f - move->r_i);
-	dc = abs(move->c_f - move->c_i);
+	dr = abs(TO_ROW(move) - FROM_ROW(move));
+	dc = abs(TO_COL(move) - FROM_COL(move));
 	if (dr * dc == 0) {
 		return rook_is_illegal(game, move, captured, castle);
 	}
@@ -330,16 +516,16 @@ static int queen_is_illegal(struct game *game, struct move *move, struct piece *
 	return ILLEGAL_MOVE;
 }
 
-static int king_is_illegal(struct game *game, struct move *move, struct piece **captured, struct move *castle) {
+static int king_is_illegal(struct game *game, struct move *move, int *captured, struct move *castle) {
 	int dr, dc;
 	int cc;
-	int c;
-	struct piece *piece, *rook;
+	int c, right, home;
+	enum player player;
 
 	UNUSED(captured);
 
-	dr = move->r_f - move->r_i;
-	dc = move->c_f - move->c_i;
+	dr = TO_ROW(move) - FROM_ROW(move);
+	dc = TO_COL(move) - FROM_COL(move);
 
 	/* regular king moves */
 
@@ -349,85 +535,74 @@ static int king_is_illegal(struct game *game, struct move *move, struct piece **
 
 	/* castling */
 
-	piece = &game->board.board[move->r_i][move->c_i];
+	player = get_piece_player(game, FROM_ROW(move), FROM_COL(move));
+	home = player == WHITE ? 7 : 0;
 
-	/* the king has already moved or this would be an improper castle */
-	if (piece->moves != 0 ||
+	/* this would be an improper castle */
+	if (FROM_ROW(move) != home || FROM_COL(move) != 4 ||
 	    dr != 0 ||
 	    abs(dc) != 2) {
 		return ILLEGAL_MOVE;
 	}
 
 	cc = (dc < 0) ? -1:1;
+	c = (dc < 0) ? 0:7;
 
-	/* find the next piece (presumably a rook) that goes in the proper
-	 * direction */
-	for (c = move->c_i + cc;
-			0 <= c &&
-			c <= 8 &&
-			game->board.board[move->r_i][c].type == EMPTY;
-			c += cc) ;
-
-	/* there is no piece */
-	if (c < 0 || c >= 8) {
-		return ILLEGAL_MOVE;
+	/* the king or the rook has already moved */
+	if (player == WHITE) {
+		right = cc < 0 ? CASTLE_WHITE_QUEENSIDE : CASTLE_WHITE_KINGSIDE;
 	}
-
-	rook = &game->board.board[move->r_i][c];
-
-	/* the next piece in the proper direction isn't a rook */
-	if (rook->type != ROOK) {
-		return ILLEGAL_MOVE;
+	else {
+		right = cc < 0 ? CASTLE_BLACK_QUEENSIDE : CASTLE_BLACK_KINGSIDE;
 	}
-	/* the rook has already moved */
-	if (rook->moves != 0) {
+	if (!(game->board.castling & right) ||
+	    game->board.squares[SQUARE(home, c)] != PIECE_CODE(player, ROOK)) {
 		return ILLEGAL_MOVE;
 	}
 
+	/* there's something between the king and the rook */
+	for (int i = FROM_COL(move) + cc; i != c; i += cc) {
+		if (!square_is_empty(game, home, i)) {
+			return ILLEGAL_MOVE;
+		}
+	}
+
 	/* we're under attack*/
-	if (piece_is_attacked(game, move->r_i, move->c_i, piece->player) ||
-	    piece_is_attacked(game, move->r_i, move->c_i + cc, piece->player) ||
-	    piece_is_attacked(game, move->r_i, move->c_i + cc*2, piece->player)) {
+	if (piece_is_attacked(game, FROM_ROW(move), FROM_COL(move), player) ||
+	    piece_is_attacked(game, FROM_ROW(move), FROM_COL(move) + cc, player) ||
+	    piece_is_attacked(game, FROM_ROW(move), FROM_COL(move) + cc*2, player)) {
 		return ILLEGAL_MOVE;
 	}
 
-	castle->r_i = castle->r_f = move->r_i;
-	castle->c_i = c;;
-	castle->c_f = move->c_i + cc;
+	*castle = pack_move(SQUARE(home, c), move_from(*move) + cc, EMPTY);
 
 	return 0;
 }
 
-static int pawn_is_illegal(struct game *game, struct move *move, struct piece **captured, struct move *castle) {
-	struct piece *piece, *dst;
+static int pawn_is_illegal(struct game *game, struct move *move, int *captured, struct move *castle) {
+	uint8_t piece, dst;
+	enum player player;
 	int direction;
 
 	UNUSED(castle);
 
 	PARSE_MOVE(game, move, piece, dst);
 
-	if (piece->player == WHITE) {
-		noop();
-	}
-
-	direction = piece->player == WHITE ? -1 : 1;
+	player = CODE_PLAYER(piece);
+	direction = player == WHITE ? -1 : 1;
 
 	/* Regular moves where pawns don't capture */
-	if (move->c_f == move->c_i) {
-		struct piece *p1, *p2;
-
-		p1 = &game->board.board[move->r_i+direction][move->c_i];
-		p2 = &game->board.board[move->r_i+direction*2][move->c_i];
-
-		if (p1->type != EMPTY) {
+	if (TO_COL(move) == FROM_COL(move)) {
+		if (is_oob(FROM_ROW(move) + direction, 0, 8) ||
+		    !square_is_empty(game, FROM_ROW(move)+direction, FROM_COL(move))) {
 			return ILLEGAL_MOVE;
 		}
-		if (move->r_i + direction == move->r_f) {
+		if (FROM_ROW(move) + direction == TO_ROW(move)) {
 			goto promote_pawn;
 		}
-		if (move->r_i + direction*2 == move->r_f &&
-		    p2->type == EMPTY &&
-		    piece->moves == 0) {
+		if (FROM_ROW(move) + direction*2 == TO_ROW(move) &&
+		    square_is_empty(game, TO_ROW(move), FROM_COL(move)) &&
+		    FROM_ROW(move) == (player == WHITE ? 6 : 1)) {
 			goto promote_pawn;
 		}
 
@@ -435,27 +610,19 @@ static int pawn_is_illegal(struct game *game, struct move *move, struct piece **
 	}
 
 	/* Pawn capture moves */
-	if (abs(move->c_f - move->c_i) == 1) {
-		struct piece *pessant;
-
-		if (move->r_i + direction != move->r_f) {
+	if (abs(TO_COL(move) - FROM_COL(move)) == 1) {
+		if (FROM_ROW(move) + direction != TO_ROW(move)) {
 			return ILLEGAL_MOVE;
 		}
 
-		pessant = &game->board.board[move->r_i][move->c_f];
-		if (dst->type != EMPTY) {
+		if (CODE_TYPE(dst) != EMPTY) {
 			goto promote_pawn;
 		}
 
 		/* en pessant */
 
-		if (pessant->type == PAWN &&
-		    pessant->player != piece->player &&
-		    pessant->moves == 1 &&
-		    ((piece->player == WHITE && move->r_i == 3) ||
-		     (piece->player == BLACK && move->r_i == 4)) &&
-		    pessant->last_move == game->duration) {
-			*captured = pessant;
+		if (move_to(*move) == game->board.en_pessant) {
+			*captured = SQUARE(FROM_ROW(move), TO_COL(move));
 			goto promote_pawn;
 		}
 		return ILLEGAL_MOVE;
@@ -464,11 +631,10 @@ static int pawn_is_illegal(struct game *game, struct move *move, struct piece **
 	return ILLEGAL_MOVE;
 promote_pawn:
 
-	if ((piece->player == WHITE && move->r_f == 0) ||
-	    (piece->player == BLACK && move->r_f == 7)) {
-		switch (move->promotion) {
+	if ((player == WHITE && TO_ROW(move) == 0) ||
+	    (player == BLACK && TO_ROW(move) == 7)) {
+		switch (move_promotion(*move)) {
 		case ROOK: case KNIGHT: case BISHOP: case QUEEN:
-			piece->type = move->promotion;
 			break;
 		default:
 			return MISSING_PROMOTION;
@@ -477,170 +643,943 @@ promote_pawn:
 	return 0;
 }
 
-static void move_unchecked(struct game *game, struct move *move, struct piece *captured, bool should_advance_clock) {
-	struct piece *src, *dst;
+static void move_unchecked(struct game *game, struct move *move, int captured, bool should_advance_clock) {
+	struct board *board = &game->board;
+	uint8_t src, dst;
+	enum piece_type type;
+	int src_sq, dst_sq;
 
 	PARSE_MOVE(game, move, src, dst);
+	src_sq = move_from(*move);
+	dst_sq = move_to(*move);
+
+	game->key ^= state_key(board);
+
 	if (should_advance_clock) {
 		++game->duration;
+		++game->since_big_move;
+		game->key ^= black_to_move_key;
+	}
+	if (CODE_TYPE(dst) != EMPTY || captured != -1 || CODE_TYPE(src) == PAWN) {
+		game->since_big_move = 0;
+	}
+	if (captured != -1) {
+		game->key ^= piece_keys[board->squares[captured]][captured];
+		clear_square(board, captured);
 	}
-	if (dst->type != EMPTY || captured != NULL) {
-		game->last_big_move = game->duration;
+
+	type = CODE_TYPE(src);
+	if (type == PAWN && (TO_ROW(move) == 0 || TO_ROW(move) == 7)) {
+		type = move_promotion(*move);
+	}
+
+	game->key ^= piece_keys[src][src_sq];
+	if (CODE_TYPE(dst) != EMPTY) {
+		game->key ^= piece_keys[dst][dst_sq];
 	}
-	if (captured != NULL) {
-		captured->type = EMPTY;
+	clear_square(board, src_sq);
+	clear_square(board, dst_sq);
+	put_piece(board, dst_sq, CODE_PLAYER(src), type);
+	game->key ^= piece_keys[PIECE_CODE(CODE_PLAYER(src), type)][dst_sq];
+
+	board->castling &= ~(castling_lost(src_sq) | castling_lost(dst_sq));
+	board->en_pessant = -1;
+	if (CODE_TYPE(src) == PAWN && abs(TO_ROW(move) - FROM_ROW(move)) == 2) {
+		int skipped = SQUARE((FROM_ROW(move) + TO_ROW(move)) / 2, FROM_COL(move));
+		if (en_pessant_possible(board, skipped, CODE_PLAYER(src))) {
+			board->en_pessant = skipped;
+		}
 	}
-	memcpy(dst, src, sizeof *dst);
-	++dst->moves;
-	dst->last_move = game->duration;
-	src->type = EMPTY;
+
+	game->key ^= state_key(board);
 }
 
-static bool piece_is_attacked(struct game *game, int r, int c, enum player player) {
-	enum player other_player = player == WHITE ? BLACK : WHITE;
-	bool ret = false;
-	enum piece_type old_type;
-	old_type = game->board.board[r][c].type;
-
-	/* If a pawn attacks an empty piece, `is_illegal` will think that that
-	 * empty space is safe, even though a piece that moves there is
-	 * attacked. */
-	if (old_type == EMPTY) {
-		game->board.board[r][c].type = PAWN;
-		game->board.board[r][c].player = player;
+uint64_t compute_key(struct game *game) {
+	uint64_t ret, pieces;
+
+	ret = state_key(&game->board);
+	if (get_player(game) == BLACK) {
+		ret ^= black_to_move_key;
+	}
+
+	pieces = occupied(&game->board);
+	while (pieces != 0) {
+		int sq = __builtin_ctzll(pieces);
+		pieces &= pieces - 1;
+		ret ^= piece_keys[game->board.squares[sq]][sq];
+	}
+
+	return ret;
+}
+
+static void init_keys(void) {
+	/* xorshift64*, seeded with a constant so that every process agrees on
+	 * every key */
+	uint64_t state = 0x9e3779b97f4a7c15ULL;
+#define NEXT_KEY() \
+	(state ^= state >> 12, state ^= state << 25, state ^= state >> 27, \
+	 state * 0x2545f4914f6cdd1dULL)
+
+	for (int code = 0; code < 16; ++code) {
+		for (int sq = 0; sq < 64; ++sq) {
+			piece_keys[code][sq] = NEXT_KEY();
+		}
+	}
+	for (int i = 0; i < 16; ++i) {
+		castling_keys[i] = NEXT_KEY();
 	}
 	for (int i = 0; i < 8; ++i) {
-		for (int j = 0; j < 8; ++j) {
-			struct move move;
-			struct piece *captured;
-			struct move castle;
+		en_pessant_keys[i] = NEXT_KEY();
+	}
+	black_to_move_key = NEXT_KEY();
+#undef NEXT_KEY
+}
 
-			if (game->board.board[i][j].type == EMPTY ||
-			    game->board.board[i][j].player == player) {
-				continue;
+static uint64_t state_key(struct board *board) {
+	uint64_t ret;
+
+	ret = castling_keys[board->castling];
+	if (board->en_pessant != -1) {
+		ret ^= en_pessant_keys[SQUARE_COL(board->en_pessant)];
+	}
+	return ret;
+}
+
+static bool en_pessant_possible(struct board *board, int sq, enum player player) {
+	enum player other_player = OTHER_PLAYER(player);
+	uint64_t pawns, king;
+	int taken;
+
+	pawns = pawn_attacks[player][sq] & board->pieces[PAWN] & board->players[other_player];
+	king = board->pieces[KING] & board->players[other_player];
+	if (pawns == 0 || king == 0) {
+		return pawns != 0;
+	}
+
+	/* both pawns leave their squares, which can uncover an attack along
+	 * the row as well as through the square the capturing pawn left */
+	taken = sq + (player == WHITE ? -8 : 8);
+	while (pawns != 0) {
+		int from = __builtin_ctzll(pawns);
+		uint64_t after;
+		pawns &= pawns - 1;
+
+		after = (occupied(board) ^ SQUARE_BIT(from) ^ SQUARE_BIT(taken)) | SQUARE_BIT(sq);
+		if ((attackers(board, __builtin_ctzll(king), player, false, after) &
+		     ~SQUARE_BIT(taken)) == 0) {
+			return true;
+		}
+	}
+	return false;
+}
+
+static int castling_lost(int sq) {
+	switch (sq) {
+	case SQUARE(7, 4):
+		return CASTLE_WHITE_KINGSIDE | CASTLE_WHITE_QUEENSIDE;
+	case SQUARE(7, 7):
+		return CASTLE_WHITE_KINGSIDE;
+	case SQUARE(7, 0):
+		return CASTLE_WHITE_QUEENSIDE;
+	case SQUARE(0, 4):
+		return CASTLE_BLACK_KINGSIDE | CASTLE_BLACK_QUEENSIDE;
+	case SQUARE(0, 7):
+		return CASTLE_BLACK_KINGSIDE;
+	case SQUARE(0, 0):
+		return CASTLE_BLACK_QUEENSIDE;
+	default:
+		return 0;
+	}
+}
+
+static void put_piece(struct board *board, int sq, enum player player, enum piece_type type) {
+	board->pieces[type] |= SQUARE_BIT(sq);
+	board->players[player] |= SQUARE_BIT(sq);
+	board->squares[sq] = PIECE_CODE(player, type);
+}
+
+static void clear_square(struct board *board, int sq) {
+	uint8_t code = board->squares[sq];
+	if (CODE_TYPE(code) == EMPTY) {
+		return;
+	}
+	board->pieces[CODE_TYPE(code)] &= ~SQUARE_BIT(sq);
+	board->players[CODE_PLAYER(code)] &= ~SQUARE_BIT(sq);
+	board->squares[sq] = EMPTY;
+}
+
+static void clear_board(struct board *board) {
+	memset(board->pieces, 0, sizeof board->pieces);
+	memset(board->players, 0, sizeof board->players);
+	memset(board->squares, EMPTY, sizeof board->squares);
+	board->castling = 0;
+	board->en_pessant = -1;
+}
+
+static bool piece_is_attacked(struct game *game, int r, int c, enum player player) {
+	return attackers(&game->board, SQUARE(r, c), player == WHITE ? BLACK : WHITE,
+			false, occupied(&game->board)) != 0;
+}
+
+FOR_PLAYER uint64_t attackers(struct board *board, int sq, enum player player, bool pext,
+		uint64_t all) {
+	uint64_t diagonal, straight;
+
+	diagonal = board->pieces[BISHOP] | board->pieces[QUEEN];
+	straight = board->pieces[ROOK] | board->pieces[QUEEN];
+
+	return ((pawn_attacks[OTHER_PLAYER(player)][sq] & board->pieces[PAWN]) |
+	        (knight_attacks[sq] & board->pieces[KNIGHT]) |
+	        (king_attacks[sq] & board->pieces[KING]) |
+	        (BISHOP_ATTACKS(pext, sq, all) & diagonal) |
+	        (ROOK_ATTACKS(pext, sq, all) & straight)) & board->players[player];
+}
+
+static bool is_in_check(struct game *game, enum player player) {
+	uint64_t king;
+	int sq;
+
+	king = game->board.pieces[KING] & game->board.players[player];
+	/* somehow the king is gone? */
+	if (king == 0) {
+		return true;
+	}
+	sq = __builtin_ctzll(king);
+	return piece_is_attacked(game, SQUARE_ROW(sq), SQUARE_COL(sq), player);
+}
+
+static int record_position(struct game *game) {
+	struct history *history = game->history;
+	int ret, window;
+
+	if (history == NULL) {
+		return 1;
+	}
+
+	history->keys[game->duration % HISTORY_SIZE] = game->key;
+
+	/* a capture or pawn move can't be undone, so nothing before the last
+	 * one can repeat */
+	window = MIN(game->since_big_move, game->duration - history->start);
+	window = MIN(window, HISTORY_SIZE - 1);
+
+	/* the same player has to be on move, and it takes at least two moves
+	 * each to get back to a position */
+	ret = 1;
+	for (int i = 4; i <= window; i += 2) {
+		if (history->keys[(game->duration - i) % HISTORY_SIZE] == game->key) {
+			++ret;
+		}
+	}
+
+	return ret;
+}
+
+static bool is_insufficient_material(struct game *game) {
+	/* 1 bits for a8, c8, ..., the squares with the same colour as a8 */
+	const uint64_t light_squares = 0xaa55aa55aa55aa55;
+	struct board *board = &game->board;
+	uint64_t minors, bishops;
+
+	if (board->pieces[PAWN] | board->pieces[ROOK] | board->pieces[QUEEN]) {
+		return false;
+	}
+
+	/* a lone knight or bishop can't mate */
+	minors = board->pieces[KNIGHT] | board->pieces[BISHOP];
+	if ((minors & (minors - 1)) == 0) {
+		return true;
+	}
+
+	/* neither can any number of bishops that are all on the same colour */
+	bishops = board->pieces[BISHOP];
+	return board->pieces[KNIGHT] == 0 &&
+		((bishops & light_squares) == 0 || (bishops & ~light_squares) == 0);
+}
+
+static bool has_legal_move_generic(struct game *game) {
+	if (get_player(game) == WHITE) {
+		return find_legal_move(game, WHITE, false);
+	}
+	return find_legal_move(game, BLACK, false);
+}
+
+#ifdef HAVE_PEXT
+BMI2_TARGET static bool has_legal_move_bmi2(struct game *game) {
+	if (get_player(game) == WHITE) {
+		return find_legal_move(game, WHITE, true);
+	}
+	return find_legal_move(game, BLACK, true);
+}
+
+static bool (*resolve_has_legal_move(void))(struct game *game) {
+	return cpu_has_fast_pext() ? has_legal_move_bmi2 : has_legal_move_generic;
+}
+
+bool has_legal_move(struct game *game) __attribute__((ifunc("resolve_has_legal_move")));
+#else
+bool has_legal_move(struct game *game) {
+	return has_legal_move_generic(game);
+}
+#endif
+
+FOR_PLAYER bool find_legal_move(struct game *game, enum player player, bool pext) {
+	/* cheapest pieces to check first. Most positions have a king move,
+	 * and it's the only kind of move that can get out of a double check */
+	static const enum piece_type order[] = { KING, KNIGHT, PAWN, BISHOP, ROOK, QUEEN };
+	struct king_safety safety;
+	uint64_t own;
+
+	if (!find_king_safety(game, player, pext, &safety)) {
+		return false;
+	}
+
+	own = game->board.players[player];
+	for (size_t i = 0; i < sizeof(order) / sizeof(*order); ++i) {
+		uint64_t pieces = game->board.pieces[order[i]] & own;
+
+		while (pieces != 0) {
+			int from = __builtin_ctzll(pieces);
+			pieces &= pieces - 1;
+
+			if (legal_targets(game, player, pext, &safety, from) != 0) {
+				return true;
 			}
+		}
+
+		if (order[i] == KING && (safety.checkers & (safety.checkers - 1)) != 0) {
+			return false;
+		}
+	}
+
+	return false;
+}
+
+static int generate_legal_moves_generic(struct game *game, struct move *out) {
+	if (get_player(game) == WHITE) {
+		return generate_moves(game, WHITE, false, out);
+	}
+	return generate_moves(game, BLACK, false, out);
+}
 
-			captured = NULL;
-			castle.r_i = castle.c_i = castle.r_f = castle.c_f = -1;
-			move.r_i = i;
-			move.c_i = j;
-			move.r_f = r;
-			move.c_f = c;
-			move.promotion = QUEEN;
-			if (is_illegal(game, &move, &captured, &castle, other_player) >= 0) {
-				ret = true;
-				goto end;
+#ifdef HAVE_PEXT
+BMI2_TARGET static int generate_legal_moves_bmi2(struct game *game, struct move *out) {
+	if (get_player(game) == WHITE) {
+		return generate_moves(game, WHITE, true, out);
+	}
+	return generate_moves(game, BLACK, true, out);
+}
+
+static int (*resolve_generate_legal_moves(void))(struct game *game, struct move *out) {
+	return cpu_has_fast_pext() ?
+		generate_legal_moves_bmi2 : generate_legal_moves_generic;
+}
+
+int generate_legal_moves(struct game *game, struct move *out)
+	__attribute__((ifunc("resolve_generate_legal_moves")));
+#else
+int generate_legal_moves(struct game *game, struct move *out) {
+	return generate_legal_moves_generic(game, out);
+}
+#endif
+
+static uint64_t legal_moves_from_generic(struct game *game, int sq) {
+	if (get_player(game) == WHITE) {
+		return find_targets_from(game, WHITE, false, sq);
+	}
+	return find_targets_from(game, BLACK, false, sq);
+}
+
+#ifdef HAVE_PEXT
+BMI2_TARGET static uint64_t legal_moves_from_bmi2(struct game *game, int sq) {
+	if (get_player(game) == WHITE) {
+		return find_targets_from(game, WHITE, true, sq);
+	}
+	return find_targets_from(game, BLACK, true, sq);
+}
+
+static uint64_t (*resolve_legal_moves_from(void))(struct game *game, int sq) {
+	return cpu_has_fast_pext() ? legal_moves_from_bmi2 : legal_moves_from_generic;
+}
+
+uint64_t legal_moves_from(struct game *game, int sq)
+	__attribute__((ifunc("resolve_legal_moves_from")));
+#else
+uint64_t legal_moves_from(struct game *game, int sq) {
+	return legal_moves_from_generic(game, sq);
+}
+#endif
+
+FOR_PLAYER uint64_t find_targets_from(struct game *game, enum player player, bool pext, int sq) {
+	struct king_safety safety;
+
+	if (!(game->board.players[player] & SQUARE_BIT(sq)) ||
+	    !find_king_safety(game, player, pext, &safety)) {
+		return 0;
+	}
+	return legal_targets(game, player, pext, &safety, sq);
+}
+
+FOR_PLAYER int generate_moves(struct game *game, enum player player, bool pext, struct move *out) {
+	struct king_safety safety;
+	uint64_t pieces;
+	int ret = 0;
+
+	if (!find_king_safety(game, player, pext, &safety)) {
+		return 0;
+	}
+
+	pieces = game->board.players[player];
+	/* only the king can get out of a double check */
+	if ((safety.checkers & (safety.checkers - 1)) != 0) {
+		pieces = SQUARE_BIT(safety.king);
+	}
+
+	while (pieces != 0) {
+		uint64_t targets;
+		bool promotes;
+		int from;
+
+		from = __builtin_ctzll(pieces);
+		pieces &= pieces - 1;
+
+		targets = legal_targets(game, player, pext, &safety, from);
+		promotes = CODE_TYPE(game->board.squares[from]) == PAWN;
+		while (targets != 0) {
+			int to;
+
+			to = __builtin_ctzll(targets);
+			targets &= targets - 1;
+
+			if (promotes && SQUARE_ROW(to) == PROMOTION_ROW(player)) {
+				for (enum piece_type p = ROOK; p <= QUEEN; ++p) {
+					out[ret++] = pack_move(from, to, p);
+				}
+				continue;
 			}
+
+			out[ret++] = pack_move(from, to, EMPTY);
 		}
 	}
-	ret = false;
-end:
-	game->board.board[r][c].type = old_type;
+
 	return ret;
 }
 
-static bool is_in_check(struct game *game, enum player player) {
-	int kr, kc;
-	for (kr = 0; kr < 8; ++kr) {
-		for (kc = 0; kc < 8; ++kc) {
-			if (game->board.board[kr][kc].type == KING &&
-			    game->board.board[kr][kc].player == player) {
-				goto found_king;
-			}
+FOR_PLAYER bool find_king_safety(struct game *game, enum player player, bool pext,
+		struct king_safety *ret) {
+	struct board *board = &game->board;
+	enum player other_player;
+	uint64_t king, all, snipers;
+
+	other_player = OTHER_PLAYER(player);
+
+	king = board->pieces[KING] & board->players[player];
+	if (king == 0) {
+		return false;
+	}
+
+	ret->king = __builtin_ctzll(king);
+	all = occupied(board);
+	ret->checkers = attackers(board, ret->king, other_player, pext, all);
+
+	/* a piece is pinned if it's the only thing between the king and an
+	 * enemy rook, bishop, or queen */
+	ret->pinned = 0;
+	snipers = ((ROOK_ATTACKS(pext, ret->king, 0) & (board->pieces[ROOK] | board->pieces[QUEEN])) |
+		   (BISHOP_ATTACKS(pext, ret->king, 0) & (board->pieces[BISHOP] | board->pieces[QUEEN]))) &
+		  board->players[other_player];
+	while (snipers != 0) {
+		int sniper;
+		uint64_t blockers;
+
+		sniper = __builtin_ctzll(snipers);
+		snipers &= snipers - 1;
+
+		blockers = between_squares[ret->king][sniper] & all;
+		if (blockers != 0 && (blockers & (blockers - 1)) == 0) {
+			ret->pinned |= blockers & board->players[player];
 		}
 	}
-	/* somehow the king is gone? */
+
+	/* a single check can be blocked or captured, a double check can't */
+	if (ret->checkers == 0) {
+		ret->evasions = ~(uint64_t) 0;
+	}
+	else if ((ret->checkers & (ret->checkers - 1)) == 0) {
+		ret->evasions = between_squares[ret->king][__builtin_ctzll(ret->checkers)] |
+			ret->checkers;
+	}
+	else {
+		ret->evasions = 0;
+	}
+
 	return true;
-found_king:
-	return piece_is_attacked(game, kr, kc, player);
 }
 
-static bool can_make_move(struct game *game, enum player player) {
-	for (int i = 0; i < 8; ++i) {
-		for (int j = 0; j < 8; ++j){
-			if (game->board.board[i][j].type == EMPTY ||
-			    game->board.board[i][j].player != player) {
+FOR_PLAYER uint64_t legal_targets(struct game *game, enum player player, bool pext,
+		struct king_safety *safety, int sq) {
+	struct board *board = &game->board;
+	enum player other_player;
+	uint64_t targets, ret;
+
+	other_player = OTHER_PLAYER(player);
+	targets = candidate_targets(game, player, pext, sq);
+	ret = 0;
+
+	switch (CODE_TYPE(board->squares[sq])) {
+	case KING: {
+		/* the king can't hide from a sliding piece by moving along the
+		 * line it's attacked on, so take it off the board first */
+		uint64_t all = occupied(board) & ~SQUARE_BIT(sq);
+		while (targets != 0) {
+			int to = __builtin_ctzll(targets);
+			targets &= targets - 1;
+
+			if (abs(SQUARE_COL(to) - SQUARE_COL(sq)) == 2) {
+				struct move move;
+				struct move castle;
+				int captured;
+
+				/* castling has too many rules to repeat
+				 * here */
+				move = pack_move(sq, to, EMPTY);
+				captured = -1;
+				castle.bits = NO_MOVE;
+				if (safety->checkers == 0 &&
+				    is_illegal(game, &move, &captured, &castle, player) >= 0) {
+					ret |= SQUARE_BIT(to);
+				}
 				continue;
 			}
-			if (piece_can_move(game, i, j)) {
-				return true;
+
+			if (attackers(board, to, other_player, pext, all) == 0) {
+				ret |= SQUARE_BIT(to);
 			}
 		}
+		return ret;
 	}
-	return false;
+	case PAWN:
+		/* en pessant takes a piece off of a different square than the
+		 * one it moves to, so it's easiest to just try it */
+		if (board->en_pessant != -1 && (targets & SQUARE_BIT(board->en_pessant))) {
+			struct move move;
+
+			targets &= ~SQUARE_BIT(board->en_pessant);
+			move = pack_move(sq, board->en_pessant, EMPTY);
+			if (leaves_king_safe(game, &move)) {
+				ret |= SQUARE_BIT(board->en_pessant);
+			}
+		}
+		break;
+	default:
+		break;
+	}
+
+	targets &= safety->evasions;
+	if (safety->pinned & SQUARE_BIT(sq)) {
+		targets &= line_through[safety->king][sq];
+	}
+	return ret | targets;
 }
 
-static bool piece_can_move(struct game *game, int row, int col) {
-	for (int i = 0; i < 8; ++i) {
-		for (int j = 0; j < 8; ++j) {
-			struct move move;
-			move.r_i = row;
-			move.c_i = col;
-			move.r_f = i;
-			move.c_f = j;
-			move.promotion = QUEEN;
-			if (make_move_dryrun(game, &move) >= 0) {
+FOR_PLAYER uint64_t candidate_targets(struct game *game, enum player player, bool pext, int sq) {
+	struct board *board = &game->board;
+	uint64_t all, ret;
+
+	all = occupied(board);
+	ret = 0;
+
+	switch (CODE_TYPE(board->squares[sq])) {
+	case ROOK:
+		ret = ROOK_ATTACKS(pext, sq, all);
+		break;
+	case BISHOP:
+		ret = BISHOP_ATTACKS(pext, sq, all);
+		break;
+	case QUEEN:
+		ret = QUEEN_ATTACKS(pext, sq, all);
+		break;
+	case KNIGHT:
+		ret = knight_attacks[sq];
+		break;
+	case KING:
+		ret = king_attacks[sq];
+		if (board->castling != 0 && sq == SQUARE(HOME_ROW(player), 4)) {
+			ret |= SQUARE_BIT(sq - 2) | SQUARE_BIT(sq + 2);
+		}
+		break;
+	case PAWN:
+		/* a pawn on its last row (only possible with a strange FEN)
+		 * gets shifted off the board, so it can't move forwards */
+		ret = FORWARD(player, SQUARE_BIT(sq)) & ~all;
+		if (SQUARE_ROW(sq) == PAWN_ROW(player)) {
+			ret |= FORWARD(player, ret) & ~all;
+		}
+		ret |= pawn_attacks[player][sq] & board->players[OTHER_PLAYER(player)];
+		if (board->en_pessant != -1) {
+			ret |= pawn_attacks[player][sq] & SQUARE_BIT(board->en_pessant);
+		}
+		break;
+	case EMPTY:
+		break;
+	}
+
+	return ret & ~board->players[player];
+}
+
+void find_check_info(struct game *game, struct check_info *info) {
+	struct board *board = &game->board;
+	enum player player, other_player;
+	uint64_t king, all, snipers;
+	int sq;
+
+	player = get_player(game);
+	other_player = player == WHITE ? BLACK : WHITE;
+
+	king = board->pieces[KING] & board->players[other_player];
+	memset(info->squares, 0, sizeof info->squares);
+	info->discoverers = 0;
+	if (king == 0) {
+		info->king = -1;
+		return;
+	}
+
+	sq = info->king = __builtin_ctzll(king);
+	all = occupied(board);
+
+	/* a piece gives check by moving onto a square it could be attacked
+	 * from */
+	info->squares[PAWN] = pawn_attacks[other_player][sq];
+	info->squares[KNIGHT] = knight_attacks[sq];
+	info->squares[BISHOP] = bishop_attacks(sq, all);
+	info->squares[ROOK] = rook_attacks(sq, all);
+	info->squares[QUEEN] = info->squares[BISHOP] | info->squares[ROOK];
+
+	/* or by getting out of the way of one of its own sliders */
+	snipers = ((rook_attacks(sq, 0) & (board->pieces[ROOK] | board->pieces[QUEEN])) |
+		   (bishop_attacks(sq, 0) & (board->pieces[BISHOP] | board->pieces[QUEEN]))) &
+		  board->players[player];
+	while (snipers != 0) {
+		int sniper;
+		uint64_t blockers;
+
+		sniper = __builtin_ctzll(snipers);
+		snipers &= snipers - 1;
+
+		blockers = between_squares[sq][sniper] & all;
+		if (blockers != 0 && (blockers & (blockers - 1)) == 0) {
+			info->discoverers |= blockers & board->players[player];
+		}
+	}
+}
+
+int gives_check(struct game *game, struct check_info *info, struct move *move) {
+	struct board *board = &game->board;
+	int from, to, ret;
+	uint8_t piece;
+
+	if (info->king == -1) {
+		return 0;
+	}
+
+	from = move_from(*move);
+	to = move_to(*move);
+	piece = board->squares[from];
+
+	/* castling moves a second piece, work out what the king can see once
+	 * both have moved */
+	if (CODE_TYPE(piece) == KING && abs(TO_COL(move) - FROM_COL(move)) == 2) {
+		int rook_from, rook_to;
+		uint64_t all, straight, diagonal, checkers;
+
+		rook_from = SQUARE(FROM_ROW(move), TO_COL(move) > FROM_COL(move) ? 7 : 0);
+		rook_to = SQUARE(FROM_ROW(move), TO_COL(move) > FROM_COL(move) ? 5 : 3);
+		all = occupied(board) ^ SQUARE_BIT(from) ^ SQUARE_BIT(to) ^
+			SQUARE_BIT(rook_from) ^ SQUARE_BIT(rook_to);
+		straight = ((board->pieces[ROOK] | board->pieces[QUEEN]) &
+				board->players[CODE_PLAYER(piece)]) ^
+			SQUARE_BIT(rook_from) ^ SQUARE_BIT(rook_to);
+		diagonal = (board->pieces[BISHOP] | board->pieces[QUEEN]) &
+			board->players[CODE_PLAYER(piece)];
+		checkers = (rook_attacks(info->king, all) & straight) |
+			(bishop_attacks(info->king, all) & diagonal);
+
+		ret = 0;
+		if (checkers & SQUARE_BIT(rook_to)) {
+			ret |= DIRECT_CHECK;
+		}
+		if (checkers & ~SQUARE_BIT(rook_to)) {
+			ret |= DISCOVERED_CHECK;
+		}
+		return ret;
+	}
+
+	/* en pessant takes a piece off of a third square, which is rare enough
+	 * to just try */
+	if (CODE_TYPE(piece) == PAWN && to == board->en_pessant) {
+		struct undo undo;
+		uint64_t checkers;
+
+		do_move(game, move, &undo);
+		checkers = attackers(board, info->king, CODE_PLAYER(piece), false, occupied(board));
+		undo_move(game, move, &undo);
+
+		ret = 0;
+		if (checkers & SQUARE_BIT(to)) {
+			ret |= DIRECT_CHECK;
+		}
+		if (checkers & ~SQUARE_BIT(to)) {
+			ret |= DISCOVERED_CHECK;
+		}
+		return ret;
+	}
+
+	ret = 0;
+	if (CODE_TYPE(piece) == PAWN && (TO_ROW(move) == 0 || TO_ROW(move) == 7)) {
+		/* the new piece might look back through the square the pawn
+		 * came from */
+		uint64_t all = (occupied(board) & ~SQUARE_BIT(from)) | SQUARE_BIT(to);
+		uint64_t attacks;
+
+		switch (move_promotion(*move)) {
+		case KNIGHT:
+			attacks = knight_attacks[to];
+			break;
+		case BISHOP:
+			attacks = bishop_attacks(to, all);
+			break;
+		case ROOK:
+			attacks = rook_attacks(to, all);
+			break;
+		default:
+			attacks = queen_attacks(to, all);
+			break;
+		}
+		if (attacks & SQUARE_BIT(info->king)) {
+			ret |= DIRECT_CHECK;
+		}
+	}
+	else if (info->squares[CODE_TYPE(piece)] & SQUARE_BIT(to)) {
+		ret |= DIRECT_CHECK;
+	}
+	if ((info->discoverers & SQUARE_BIT(from)) &&
+	    !(line_through[info->king][from] & SQUARE_BIT(to))) {
+		ret |= DISCOVERED_CHECK;
+	}
+	return ret;
+}
+
+bool has_check_evasion(struct game *game) {
+	struct board *board = &game->board;
+	enum player player, other_player;
+	uint64_t own, all, king_bit, checkers, targets;
+	int king, checker;
+
+	player = get_player(game);
+	other_player = OTHER_PLAYER(player);
+	own = board->players[player];
+	all = occupied(board);
+
+	if ((king_bit = board->pieces[KING] & own) == 0) {
+		return false;
+	}
+	king = __builtin_ctzll(king_bit);
+
+	/* most checks can just be walked out of */
+	targets = king_attacks[king] & ~own;
+	while (targets != 0) {
+		int to = __builtin_ctzll(targets);
+		targets &= targets - 1;
+
+		if (attackers(board, to, other_player, false, all ^ king_bit) == 0) {
+			return true;
+		}
+	}
+
+	/* en pessant can take a checking pawn, and is rare enough to just try
+	 * every way of doing it */
+	if (board->en_pessant != -1) {
+		int taken = board->en_pessant + (player == WHITE ? 8 : -8);
+		uint64_t pawns = pawn_attacks[other_player][board->en_pessant] &
+			board->pieces[PAWN] & own;
+
+		while (pawns != 0) {
+			int from = __builtin_ctzll(pawns);
+			uint64_t after;
+			pawns &= pawns - 1;
+
+			after = (all ^ SQUARE_BIT(from) ^ SQUARE_BIT(taken)) |
+				SQUARE_BIT(board->en_pessant);
+			if ((attackers(board, king, other_player, false, after) &
+			     ~SQUARE_BIT(taken)) == 0) {
+				return true;
+			}
+		}
+	}
+
+	checkers = attackers(board, king, other_player, false, all);
+	if (checkers == 0) {
+		return has_legal_move(game);
+	}
+	/* nothing but the king can get out of a double check */
+	if ((checkers & (checkers - 1)) != 0) {
+		return false;
+	}
+	checker = __builtin_ctzll(checkers);
+
+	/* otherwise some other piece has to take the checker or get in the
+	 * way, without uncovering a different attack on the king */
+	targets = between_squares[king][checker] | checkers;
+	while (targets != 0) {
+		int to = __builtin_ctzll(targets);
+		uint64_t from_squares;
+		targets &= targets - 1;
+
+		if (to == checker) {
+			from_squares = attackers(board, to, player, false, all) & ~king_bit;
+		}
+		else {
+			uint64_t pushed = FORWARD(other_player, SQUARE_BIT(to));
+
+			from_squares = ((knight_attacks[to] & board->pieces[KNIGHT]) |
+					(bishop_attacks(to, all) & (board->pieces[BISHOP] | board->pieces[QUEEN])) |
+					(rook_attacks(to, all) & (board->pieces[ROOK] | board->pieces[QUEEN])) |
+					(pushed & board->pieces[PAWN])) & own;
+			/* a pawn on its first row can jump over the square in
+			 * front of it */
+			if ((pushed & all) == 0 &&
+			    SQUARE_ROW(to) == PAWN_ROW(player) + (player == WHITE ? -2 : 2)) {
+				from_squares |= FORWARD(other_player, pushed) & board->pieces[PAWN] & own;
+			}
+		}
+
+		while (from_squares != 0) {
+			int from = __builtin_ctzll(from_squares);
+			uint64_t after;
+			from_squares &= from_squares - 1;
+
+			after = (all ^ SQUARE_BIT(from)) | SQUARE_BIT(to);
+			if ((attackers(board, king, other_player, false, after) &
+			     ~SQUARE_BIT(to)) == 0) {
 				return true;
 			}
 		}
 	}
+
 	return false;
 }
 
+void write_fen(struct game *game, char buff[FEN_SIZE]) {
+	struct board *board = &game->board;
+	int len;
+
+	len = 0;
+	for (int r = 0; r < 8; ++r) {
+		int empty = 0;
+		for (int c = 0; c < 8; ++c) {
+			int code = board->squares[SQUARE(r, c)];
+			char ch;
+
+			if (CODE_TYPE(code) == EMPTY) {
+				++empty;
+				continue;
+			}
+			if (empty > 0) {
+				buff[len++] = empty + '0';
+				empty = 0;
+			}
+			ch = piece_to_char(CODE_TYPE(code));
+			buff[len++] = CODE_PLAYER(code) == WHITE ? toupper(ch) : ch;
+		}
+		if (empty > 0) {
+			buff[len++] = empty + '0';
+		}
+		buff[len++] = r == 7 ? ' ' : '/';
+	}
+
+	buff[len++] = get_player(game) == WHITE ? 'w' : 'b';
+	buff[len++] = ' ';
+
+	if (board->castling == 0) {
+		buff[len++] = '-';
+	}
+	if (board->castling & CASTLE_WHITE_KINGSIDE) {
+		buff[len++] = 'K';
+	}
+	if (board->castling & CASTLE_WHITE_QUEENSIDE) {
+		buff[len++] = 'Q';
+	}
+	if (board->castling & CASTLE_BLACK_KINGSIDE) {
+		buff[len++] = 'k';
+	}
+	if (board->castling & CASTLE_BLACK_QUEENSIDE) {
+		buff[len++] = 'q';
+	}
+	buff[len++] = ' ';
+
+	if (board->en_pessant == -1) {
+		buff[len++] = '-';
+	}
+	else {
+		buff[len++] = SQUARE_COL(board->en_pessant) + 'a';
+		buff[len++] = 8 - SQUARE_ROW(board->en_pessant) + '0';
+	}
+
+	snprintf(buff + len, FEN_SIZE - len, " %d %d",
+			game->since_big_move, game->duration / 2 + 1);
+}
+
 enum player get_player(struct game *game) {
 	return game->duration % 2 == 0 ? WHITE : BLACK;
 }
 
 int init_game(struct game *game, char *state) {
-	int r, c, i, duration;
+	int r, c, i, duration, since_big_move;
 	char ch;
+	enum piece_type type;
+
+	clear_board(&game->board);
 
 	r = c = 0;
 	for (i = 0; state[i] != ' '; ++i) {
 		switch (tolower(state[i])) {
 		case '/':
-			if (c != 8) {
+			if (c != 8 || r >= 7) {
 				return -1;
 			}
 			++r;
 			c = 0;
 			continue;
 		case 'r':
-			game->board.board[r][c].type = ROOK;
-			goto finish_generic;
+			type = ROOK;
+			goto place_piece;
 		case 'n':
-			game->board.board[r][c].type = KNIGHT;
-			goto finish_generic;
+			type = KNIGHT;
+			goto place_piece;
 		case 'b':
-			game->board.board[r][c].type = BISHOP;
-			goto finish_generic;
+			type = BISHOP;
+			goto place_piece;
 		case 'q':
-			game->board.board[r][c].type = QUEEN;
-			goto finish_generic;
+			type = QUEEN;
+			goto place_piece;
 		case 'k':
-			game->board.board[r][c].type = KING;
-			game->board.board[r][c].moves = 0;
-			goto finish_special;
+			type = KING;
+			goto place_piece;
 		case 'p':
-			game->board.board[r][c].type = PAWN;
-			game->board.board[r][c].moves = islower(state[i]) ?
-				(r == 1 ? 0:1) :
-				(r == 6 ? 0:1);
-			goto finish_special;
-		finish_generic:
-			game->board.board[r][c].moves = 1;
-			/* fallthrough */
-		finish_special:
-			game->board.board[r][c].player = islower(state[i]) ? BLACK : WHITE;
-			game->board.board[r][c].last_move = 0;
+			type = PAWN;
+			goto place_piece;
+		place_piece:
+			if (c >= 8) {
+				return -1;
+			}
+			put_piece(&game->board, SQUARE(r, c),
+					islower(state[i]) ? BLACK : WHITE, type);
 			++c;
 			break;
 		digit:
-			for (int o = 0; o < state[i] - '0'; ++o) {
-				if (c >= 8) {
-					return -1;
-				}
-				game->board.board[r][c++].type = EMPTY;
+			c += state[i] - '0';
+			if (c > 8) {
+				return -1;
 			}
 			break;
 		default:
@@ -676,18 +1615,17 @@ int init_game(struct game *game, char *state) {
 	for (;;) {
 		char c = state[++i];
 		switch (c) {
-#define ROOK_CASTLE(ch, r, c, p) \
+#define ROOK_CASTLE(ch, r, c, p, right) \
 		case ch: \
-			if (game->board.board[r][c].type != ROOK || \
-			    game->board.board[r][c].player != p) { \
+			if (game->board.squares[SQUARE(r, c)] != PIECE_CODE(p, ROOK)) { \
 				return -1; \
 			} \
-			game->board.board[r][c].moves = 0; \
+			game->board.castling |= right; \
 			break
-		ROOK_CASTLE('K', 7, 7, WHITE);
-		ROOK_CASTLE('Q', 7, 0, WHITE);
-		ROOK_CASTLE('k', 0, 7, BLACK);
-		ROOK_CASTLE('q', 0, 0, BLACK);
+		ROOK_CASTLE('K', 7, 7, WHITE, CASTLE_WHITE_KINGSIDE);
+		ROOK_CASTLE('Q', 7, 0, WHITE, CASTLE_WHITE_QUEENSIDE);
+		ROOK_CASTLE('k', 0, 7, BLACK, CASTLE_BLACK_KINGSIDE);
+		ROOK_CASTLE('q', 0, 0, BLACK, CASTLE_BLACK_QUEENSIDE);
 #undef ROOK_CASTLE
 		case '-':
 			if (state[++i] != ' ') {
@@ -702,8 +1640,7 @@ int init_game(struct game *game, char *state) {
 	}
 got_castles:
 
-	/* We're reusing variable names! [r, c] is now the location of the en
-	 * pessant pawn */
+	/* We're reusing variable names! [r, c] is now the en pessant square */
 	switch (ch = state[++i]) {
 	case '-':
 		r = c = -1;
@@ -721,8 +1658,18 @@ got_castles:
 	}
 
 	switch (ch = state[++i]) {
-	case '2': r = 3; break;
-	case '5': r = 4; break;
+	case '3': r = 5; break;
+	case '6': r = 2; break;
+	default:
+		  return -1;
+	}
+
+	/* only remember the en pessant square if there's actually a pawn in
+	 * front of it, and one that could take it */
+	if (game->board.squares[SQUARE(r == 5 ? 4 : 3, c)] !=
+			PIECE_CODE(r == 5 ? WHITE : BLACK, PAWN) ||
+	    !en_pessant_possible(&game->board, SQUARE(r, c), r == 5 ? WHITE : BLACK)) {
+		r = c = -1;
 	}
 no_en_pessant:
 
@@ -730,16 +1677,15 @@ no_en_pessant:
 	case ' ':
 		break;
 	case '\0':
-		game->last_big_move = duration = 0;
+		since_big_move = duration = 0;
 		goto got_clock;
 	default:
 		return -1;
 	}
 
-	if ((game->last_big_move = parse_int(state, ++i, &i)) == -1) {
+	if ((since_big_move = parse_int(state, ++i, &i)) == -1) {
 		return -1;
 	}
-	game->last_big_move *= -1;
 
 	if (state[i++] != ' ') {
 		return -1;
@@ -751,14 +1697,23 @@ no_en_pessant:
 	duration *= 2;
 
 got_clock:
+	if (since_big_move > UINT16_MAX || duration + game->duration > UINT16_MAX) {
+		return -1;
+	}
 	game->duration += duration;
-	game->board.board[r][c].last_move += game->duration;
-	game->last_big_move += duration;
+	game->since_big_move = since_big_move;
+	game->board.en_pessant = r == -1 ? -1 : SQUARE(r, c);
+	game->key = compute_key(game);
 
 	if (state[i] != '\0') {
 		return -1;
 	}
 
+	if (game->history != NULL) {
+		game->history->start = game->duration;
+		record_position(game);
+	}
+
 	return 0;
 }
 
@@ -777,39 +1732,45 @@ static int parse_int(char *s, int start, int *end) {
 }
 
 int parse_move(struct move *ret, char *move) {
+	int c_i, r_i, c_f, r_f;
+	enum piece_type promotion;
+
 	if (strlen(move) < 4) {
 		return ILLEGAL_MOVE;
 	}
-	ret->c_i = tolower(move[0]) - 'a';
-	ret->r_i = 8 - (move[1] - '0');
-	ret->c_f = tolower(move[2]) - 'a';
-	ret->r_f = 8 - (move[3] - '0');
-	ret->promotion = EMPTY;
+	c_i = tolower(move[0]) - 'a';
+	r_i = 8 - (move[1] - '0');
+	c_f = tolower(move[2]) - 'a';
+	r_f = 8 - (move[3] - '0');
+	/* a packed move is always on the board, so off the board moves have
+	 * to be caught here */
+	if (is_oob(r_i, 0, 8) || is_oob(c_i, 0, 8) ||
+	    is_oob(r_f, 0, 8) || is_oob(c_f, 0, 8)) {
+		return ILLEGAL_MOVE;
+	}
+	promotion = EMPTY;
 	switch (tolower(move[4])) {
-	case 'n': ret->promotion = KNIGHT; break;
-	case 'q': ret->promotion = QUEEN;  break;
-	case 'r': ret->promotion = ROOK;   break;
-	case 'b': ret->promotion = BISHOP; break;
+	case 'n': promotion = KNIGHT; break;
+	case 'q': promotion = QUEEN;  break;
+	case 'r': promotion = ROOK;   break;
+	case 'b': promotion = BISHOP; break;
 	case '\0': break;
 	default: return ILLEGAL_MOVE;
 	}
+	*ret = pack_move(SQUARE(r_i, c_i), SQUARE(r_f, c_f), promotion);
 	return 0;
 }
 
-char *move_to_string(struct move *move) {
-	char *ret;
-	if ((ret = malloc(6)) == NULL) {
-		return NULL;
-	}
-	ret[0] = move->c_i + 'a';
-	ret[1] = 8-move->r_i + '0';
-	ret[2] = move->c_f + 'a';
-	ret[3] = 8-move->r_f + '0';
-	if (move->promotion == EMPTY) {
+char *move_to_string(struct move *move, char ret[MOVE_STRING_SIZE]) {
+	ret[0] = FROM_COL(move) + 'a';
+	ret[1] = 8-FROM_ROW(move) + '0';
+	ret[2] = TO_COL(move) + 'a';
+	ret[3] = 8-TO_ROW(move) + '0';
+	if (move_promotion(*move) == EMPTY) {
 		ret[4] = '\0';
 		return ret;
 	}
-	ret[4] = piece_to_char(move->promotion);
+	ret[4] = piece_to_char(move_promotion(*move));
 	ret[5] = '\0';
 	return ret;
 }
@@ -0,0 +1,294 @@
+/* chessh - chess over ssh
+ * Copyright (C) 2024  Nate Choe <nate@natechoe.dev>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * */
+#include <stdio.h>
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <util.h>
+
+#include <client/epd.h>
+#include <client/chess.h>
+#include <client/pool.h>
+
+/* the deepest count an EPD line can ask for */
+#define EPD_MAX_DEPTH 15
+
+struct epd_position {
+	char *line; /* the whole line, the FEN is cut off at the first ';' */
+	char *fen;
+	int line_no;
+
+	/* expected[n] is the count given for Dn, if `given` has bit n set */
+	unsigned long long expected[EPD_MAX_DEPTH + 1];
+	unsigned long long got[EPD_MAX_DEPTH + 1];
+	unsigned int given;
+	int depth; /* the deepest Dn that will be checked */
+
+	bool bad_fen;
+	bool passed;
+	double seconds;
+};
+
+struct epd_job {
+	struct epd_position *positions;
+};
+
+/* reads every position out of `path` into `*ret` and returns how many there
+ * are, -1 on error */
+static int read_epd(char *path, int level, struct epd_position **ret);
+
+/* parses the ";D1 20 ;D2 400" part of an EPD line into `position`, returns -1
+ * on error */
+static int parse_counts(char *counts, int level, struct epd_position *position);
+
+/* the pool_fn, each task is the index of a position */
+static void run_epd_task(struct pool *pool, int worker, void *task, void *aux);
+
+static double get_time(void);
+
+int run_epd(struct perft_options *options) {
+	struct epd_position *positions;
+	struct epd_job job;
+	struct pool *pool;
+	int count, passed, ret;
+	double start, elapsed;
+
+	if ((count = read_epd(options->epd, options->level, &positions)) < 0) {
+		return 1;
+	}
+
+	ret = 1;
+	job.positions = positions;
+	if ((pool = new_pool(options->threads, sizeof(int), run_epd_task, &job)) == NULL) {
+		fputs("Failed to initialize variables\n", stderr);
+		goto end;
+	}
+
+	for (int i = 0; i < count; ++i) {
+		if (pool_push(pool, i % options->threads, &i) < 0) {
+			fputs("Failed to queue positions\n", stderr);
+			goto end;
+		}
+	}
+
+	start = get_time();
+	if (pool_run(pool) < 0) {
+		fputs("Failed to run positions\n", stderr);
+		goto end;
+	}
+	elapsed = get_time() - start;
+	free_pool(pool);
+	pool = NULL;
+
+	printf("%5s  %-4s  %5s  %12s  %9s  %s\n", "line", "", "depth", "nodes", "time", "position");
+	passed = 0;
+	for (int i = 0; i < count; ++i) {
+		struct epd_position *position = &positions[i];
+
+		printf("%5d  %-4s  %5d  %12llu  %8.3fs  %s\n", position->line_no,
+				position->passed ? "pass" : "FAIL", position->depth,
+				position->bad_fen ? 0 : position->got[position->depth],
+				position->seconds, position->fen);
+
+		if (position->passed) {
+			++passed;
+			continue;
+		}
+		if (position->bad_fen) {
+			puts("       invalid position");
+			continue;
+		}
+		for (int depth = 1; depth <= position->depth; ++depth) {
+			if ((position->given & (1u << depth)) &&
+			    position->got[depth] != position->expected[depth]) {
+				printf("       D%d: got %llu, expected %llu\n", depth,
+						position->got[depth], position->expected[depth]);
+			}
+		}
+	}
+	printf("%d positions, %d passed, %d failed in %.3fs\n", count, passed,
+			count - passed, elapsed);
+	ret = passed == count ? 0 : 1;
+
+end:
+	if (pool != NULL) {
+		free_pool(pool);
+	}
+	for (int i = 0; i < count; ++i) {
+		free(positions[i].line);
+	}
+	free(positions);
+	return ret;
+}
+
+static int read_epd(char *path, int level, struct epd_position **ret) {
+	FILE *file;
+	char *line;
+	size_t line_alloc;
+	ssize_t line_len;
+	int count, alloc, line_no;
+
+	if ((file = fopen(path, "r")) == NULL) {
+		perror("Failed to open EPD file");
+		return -1;
+	}
+
+	*ret = NULL;
+	line = NULL;
+	line_alloc = 0;
+	count = alloc = line_no = 0;
+	while ((line_len = getline(&line, &line_alloc, file)) >= 0) {
+		struct epd_position *position;
+		char *counts, *end;
+
+		++line_no;
+		while (line_len > 0 && isspace((unsigned char) line[line_len - 1])) {
+			line[--line_len] = '\0';
+		}
+		if (line_len == 0 || line[0] == '#') {
+			continue;
+		}
+
+		if (count >= alloc) {
+			struct epd_position *new_ret;
+			alloc = alloc == 0 ? 64 : alloc * 2;
+			if ((new_ret = realloc(*ret, alloc * sizeof *new_ret)) == NULL) {
+				goto error;
+			}
+			*ret = new_ret;
+		}
+
+		position = &(*ret)[count];
+		memset(position, 0, sizeof *position);
+		position->line_no = line_no;
+		if ((position->line = strdup(line)) == NULL) {
+			goto error;
+		}
+		++count;
+
+		position->fen = position->line;
+		if ((counts = strchr(position->line, ';')) == NULL) {
+			fprintf(stderr, "%s:%d: no perft counts\n", path, line_no);
+			goto error;
+		}
+		*counts++ = '\0';
+		for (end = counts - 1; end > position->fen && isspace((unsigned char) end[-1]); --end) {
+			end[-1] = '\0';
+		}
+
+		if (parse_counts(counts, level, position) < 0) {
+			fprintf(stderr, "%s:%d: invalid perft counts\n", path, line_no);
+			goto error;
+		}
+	}
+
+	free(line);
+	fclose(file);
+	return count;
+error:
+	for (int i = 0; i < count; ++i) {
+		free((*ret)[i].line);
+	}
+	free(*ret);
+	free(line);
+	fclose(file);
+	return -1;
+}
+
+static int parse_counts(char *counts, int level, struct epd_position *position) {
+	char *field;
+
+	for (field = strtok(counts, ";"); field != NULL; field = strtok(NULL, ";")) {
+		char *end;
+		long depth;
+		unsigned long long expected;
+
+		while (isspace((unsigned char) *field)) {
+			++field;
+		}
+		if (*field == '\0') {
+			continue;
+		}
+		/* other EPD operations are none of our business */
+		if (field[0] != 'D' || !isdigit((unsigned char) field[1])) {
+			continue;
+		}
+
+		depth = strtol(field + 1, &end, 10);
+		if (depth < 1 || depth > EPD_MAX_DEPTH || !isspace((unsigned char) *end)) {
+			return -1;
+		}
+		expected = strtoull(end, &end, 10);
+		while (isspace((unsigned char) *end)) {
+			++end;
+		}
+		if (*end != '\0') {
+			return -1;
+		}
+
+		if (level > 0 && depth >= level) {
+			continue;
+		}
+		position->expected[depth] = expected;
+		position->given |= 1u << depth;
+		if (depth > position->depth) {
+			position->depth = depth;
+		}
+	}
+
+	return 0;
+}
+
+static void run_epd_task(struct pool *pool, int worker, void *task, void *aux) {
+	struct epd_job *job = aux;
+	struct epd_position *position = &job->positions[*(int *) task];
+	struct game *game;
+	double start;
+
+	UNUSED(pool);
+	UNUSED(worker);
+
+	start = get_time();
+	if ((game = new_game()) == NULL || init_game(game, position->fen) != 0) {
+		position->bad_fen = true;
+		position->passed = false;
+		if (game != NULL) {
+			free_game(game);
+		}
+		return;
+	}
+
+	count_perft(game, position->depth + 1, position->got);
+	free_game(game);
+	position->seconds = get_time() - start;
+
+	position->passed = true;
+	for (int depth = 1; depth <= position->depth; ++depth) {
+		if ((position->given & (1u << depth)) &&
+		    position->got[depth] != position->expected[depth]) {
+			position->passed = false;
+		}
+	}
+}
+
+static double get_time(void) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec + now.tv_nsec / 1e9;
+}
@@ -29,6 +29,8 @@ char *frontend_strerror(int code) {
 		return "Black wins!";
 	case MSG_FORCED_DRAW:
 		return "It's a draw!";
+	case MSG_DRAW_OFFER:
+		return "Either player can claim a draw";
 	case IO_ERROR:
 		return "I/O error";
 	case MSG_WAITING_FOR_MOVE:
@@ -19,9 +19,11 @@
 #include <stdlib.h>
 
 #include <getopt.h>
+#include <limits.h>
 
 #include <legal.h>
 #include <client/users.h>
+#include <client/epd.h>
 #include <client/perft.h>
 #include <client/runner.h>
 
@@ -30,10 +32,7 @@ struct client_args {
 	char *user;
 	char *pass;
 
-	int perft;
-	char *start_pos;
-	char *start_sequence;
-	bool autotest;
+	struct perft_options perft;
 
 	bool register_user;
 };
@@ -48,8 +47,16 @@ int main(int argc, char *argv[]) {
 
 	parse_args(argc, argv, &args);
 
-	if (args.perft != -1) {
-		return run_perft(args.perft, args.start_pos, args.start_sequence, args.autotest);
+	if (args.perft.server) {
+		return run_perft_server(&args.perft);
+	}
+
+	if (args.perft.epd != NULL) {
+		return run_epd(&args.perft);
+	}
+
+	if (args.perft.level != -1) {
+		return run_perft(&args.perft);
 	}
 
 	if ((dbp = init_user_db()) == NULL) {
@@ -72,13 +79,29 @@ int main(int argc, char *argv[]) {
 
 static void parse_args(int argc, char *argv[], struct client_args *ret) {
 	ret->dir = ret->user = ret->pass = NULL;
-	ret->perft = -1;
-	ret->start_pos = ret->start_sequence = NULL;
-	ret->autotest = false;
+	ret->perft.level = -1;
+	ret->perft.start_pos = ret->perft.start_sequence = NULL;
+	ret->perft.autotest = false;
+	ret->perft.fast = false;
+	ret->perft.check = false;
+	ret->perft.threads = 1;
+	ret->perft.hash_mb = 0;
+	ret->perft.breakdown = false;
+	ret->perft.epd = NULL;
+	ret->perft.server = false;
 	ret->register_user = false;
 
+	/* long options that don't have a short version */
+	enum {
+		OPT_HASH = CHAR_MAX + 1,
+	};
+	static const struct option long_options[] = {
+		{ "hash", required_argument, NULL, OPT_HASH },
+		{ NULL, 0, NULL, 0 },
+	};
+
 	for (;;) {
-		int opt = getopt(argc, argv, "hld:u:p:t:i:s:amr");
+		int opt = getopt_long(argc, argv, "hld:u:p:t:T:cj:be:Si:s:amr", long_options, NULL);
 		switch (opt) {
 		case -1:
 			goto got_args;
@@ -98,16 +121,44 @@ static void parse_args(int argc, char *argv[], struct client_args *ret) {
 			ret->pass = optarg;
 			break;
 		case 't':
-			ret->perft = atoi(optarg);
+			ret->perft.level = atoi(optarg);
+			break;
+		case 'T':
+			ret->perft.level = atoi(optarg);
+			ret->perft.fast = true;
+			break;
+		case 'c':
+			ret->perft.check = true;
+			break;
+		case 'j':
+			if ((ret->perft.threads = atoi(optarg)) < 1) {
+				fprintf(stderr, "%s: invalid thread count\n", argv[0]);
+				exit(EXIT_FAILURE);
+			}
+			break;
+		case 'b':
+			ret->perft.breakdown = true;
+			break;
+		case 'e':
+			ret->perft.epd = optarg;
+			break;
+		case 'S':
+			ret->perft.server = true;
+			break;
+		case OPT_HASH:
+			if ((ret->perft.hash_mb = atol(optarg)) < 1) {
+				fprintf(stderr, "%s: invalid hash size\n", argv[0]);
+				exit(EXIT_FAILURE);
+			}
 			break;
 		case 'i':
-			ret->start_pos = optarg;
+			ret->perft.start_pos = optarg;
 			break;
 		case 's':
-			ret->start_sequence = optarg;
+			ret->perft.start_sequence = optarg;
 			break;
 		case 'a':
-			ret->autotest = true;
+			ret->perft.autotest = true;
 			break;
 		case 'r':
 			ret->register_user = true;
@@ -119,7 +170,7 @@ static void parse_args(int argc, char *argv[], struct client_args *ret) {
 	}
 got_args:
 
-	if (ret->perft != -1) {
+	if (ret->perft.level != -1 || ret->perft.epd != NULL || ret->perft.server) {
 		return;
 	}
 
@@ -137,6 +188,14 @@ static void print_help(char *progname) {
 	puts("  -h: Show this help and quit");
 	puts("  -l: Show a legal notice and quit");
 	puts("  -t [level]: Run a perft test with [level] levels");
+	puts("  -T [level]: Run a fast perft test with the move generator");
+	puts("  -c: Check the fast perft test's results against the slow one");
+	puts("  -j [threads]: Use [threads] threads for the fast perft test");
+	puts("  --hash [MB]: Give the fast perft test a [MB] MB hash table");
+	puts("  -b: Break the fast perft test's results down by move type");
+	puts("  -e [file]: Check every position in an EPD file of perft counts,");
+	puts("             with -T [level] to skip the deeper counts");
+	puts("  -S: Answer \"[depth] [fen] [moves]\" perft requests on stdin until EOF");
 	puts("  -i [start]: Use [start] as the starting position for the perft test");
 	puts("  -s [sequence]: Run [sequence] before beginning the perft test");
 	puts("  -a: Produce a test output suitable for automatic testing with perftree");
@@ -18,62 +18,364 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
+#include <stdatomic.h>
 
 #include <util.h>
 
 #include <client/perft.h>
 #include <client/chess.h>
+#include <client/pool.h>
 
+/* tasks with at least this many levels left under them get split up when
+ * some thread runs out of work */
+#define SPLIT_DEPTH 4
+
+/* a shared cache of perft counts. Each entry stores its key XORed with its
+ * count, so that a thread reading an entry halfway through another thread's
+ * write sees a key that doesn't match instead of a wrong count. This lets
+ * every thread use the table without locks. */
+struct perft_entry {
+	_Atomic uint64_t check; /* the entry's key ^ count */
+	_Atomic uint64_t count;
+};
+
+struct perft_table {
+	struct perft_entry *entries;
+	uint64_t mask; /* the number of entries - 1, always a power of two */
+};
+
+struct hash_stats {
+	unsigned long long probes;
+	unsigned long long hits;
+};
+
+/* the usual columns of published perft tables, each counting the moves that
+ * lead to a level */
+struct perft_breakdown {
+	unsigned long long captures;
+	unsigned long long en_pessants;
+	unsigned long long castles;
+	unsigned long long promotions;
+	unsigned long long checks;
+	unsigned long long discovered_checks;
+	unsigned long long double_checks;
+	unsigned long long checkmates;
+};
+
+/* one subtree of a fast perft test */
+struct perft_task {
+	struct game game;
+	int depth; /* the game's depth in the whole tree */
+	int root; /* the index of the root move this subtree is under */
+};
+
+struct perft_job {
+	int level;
+	int root_moves;
+
+	/* every thread gets its own `level` results and `root_moves` leaf
+	 * counts, these get added up once everything is done */
+	unsigned long long *results;
+	unsigned long long *root_leaves;
+
+	/* `level` breakdowns per thread, NULL if they aren't wanted */
+	struct perft_breakdown *breakdown;
+
+	struct perft_table *table; /* NULL if there's no hash table */
+	struct hash_stats *stats; /* one per thread */
+
+	atomic_bool failed;
+};
+
+/* returns the game described by `start_pos` and `start_sequence`, NULL on
+ * error */
+static struct game *setup_game(char *start_pos, char *start_sequence);
+/* plays the space separated moves in `sequence`, returns 1 if one of them
+ * can't be played */
 static int run_sequence(struct game *game, char *sequence);
 static void calculate_perft(struct game *game, int curr_depth, int max_depth, unsigned long long *results,
-		int r_pi, int c_pi, int r_pf, int c_pf, bool autotest);
+		struct move parent, bool autotest);
 static void add_node(struct game *game, int curr_depth, int max_depth, unsigned long long *results,
-		int r_i, int c_i, int r_f, int c_f, enum piece_type promotion, bool autotest);
-static void print_move(int ri, int ci, int rf, int cf, unsigned long long diff);
+		struct move move, bool autotest);
+
+/* the same thing as calculate_perft, but with the move generator and
+ * do_move(). The last level isn't played out, just counted. `breakdown` may be
+ * NULL. */
+static void fast_perft(struct game *game, int curr_depth, int max_depth, unsigned long long *results,
+		struct perft_breakdown *breakdown);
+
+/* adds the `move_count` legal moves in `moves` to `breakdown` */
+static void count_breakdown(struct game *game, struct move *moves, int move_count,
+		struct perft_breakdown *breakdown);
 
-int run_perft(int level, char *start_pos, char *start_sequence, bool autotest) {
+/* returns a table using about `megabytes` MB, NULL on error */
+static struct perft_table *new_perft_table(long megabytes);
+static void free_perft_table(struct perft_table *table);
+
+/* returns the number of leaves `depth` levels under `game`, going through
+ * `table` */
+static unsigned long long hashed_perft(struct perft_table *table, struct game *game, int depth,
+		struct hash_stats *stats);
+
+/* splits the tree under `game` by root move and runs fast_perft over it with
+ * `options->threads` threads, going through `table` if it isn't NULL. Prints
+ * divide lines in autotest mode, like the oracle. Returns -1 on error. */
+static int run_fast_perft(struct game *game, struct perft_options *options, unsigned long long *results,
+		struct perft_breakdown *breakdown, struct perft_table *table);
+
+/* reads one request for run_perft_server, writing its answer to stdout */
+static void serve_request(struct perft_options *options, char *request, struct perft_table *table);
+
+/* the pool_fn for struct perft_task */
+static void run_perft_task(struct pool *pool, int worker, void *task, void *aux);
+
+/* returns the number of seconds since some arbitrary point */
+static double get_time(void);
+
+static void print_move(struct move move, unsigned long long diff);
+static void print_results(struct perft_options *options, unsigned long long *results,
+		struct perft_breakdown *breakdown);
+
+int run_perft(struct perft_options *options) {
 	unsigned long long *results;
+	struct perft_breakdown *breakdown;
+	struct perft_table *table;
 	struct game *game;
+	int level = options->level;
+	double start, elapsed;
+	unsigned long long nodes;
+
+	if (level <= 0) {
+		fputs("Invalid perft level\n", stderr);
+		return 1;
+	}
 
 	results = alloca(level * sizeof *results);
 	memset(results, 0, level * sizeof *results);
-	game = new_game();
+	breakdown = NULL;
+	if (options->breakdown) {
+		breakdown = alloca(level * sizeof *breakdown);
+		memset(breakdown, 0, level * sizeof *breakdown);
+	}
 
-	if (start_pos != NULL) {
-		if (init_game(game, start_pos)) {
-			fputs("Failed to initialize game\n", stderr);
+	if ((game = setup_game(options->start_pos, options->start_sequence)) == NULL) {
+		return 1;
+	}
+
+	if (!options->fast) {
+		if (options->threads != 1 || options->hash_mb != 0 || options->breakdown) {
+			fputs("-j, -b and --hash only work with -T\n", stderr);
+			free_game(game);
 			return 1;
 		}
+		calculate_perft(game, 0, level, results, pack_move(0, 0, EMPTY), options->autotest);
+		free_game(game);
+		print_results(options, results, NULL);
+		return 0;
 	}
 
-	if (start_sequence != NULL) {
-		int code;
-		code = run_sequence(game, start_sequence);
-		if (code != 0) {
-			return code;
+	if (options->breakdown && (options->hash_mb != 0 || options->autotest)) {
+		fputs("-b doesn't work with --hash or -a\n", stderr);
+		free_game(game);
+		return 1;
+	}
+
+	table = NULL;
+	if (options->hash_mb > 0 && (table = new_perft_table(options->hash_mb)) == NULL) {
+		fputs("Failed to allocate hash table\n", stderr);
+		free_game(game);
+		return 1;
+	}
+
+	start = get_time();
+	if (run_fast_perft(game, options, results, breakdown, table) < 0) {
+		fputs("Failed to run perft test\n", stderr);
+		if (table != NULL) {
+			free_perft_table(table);
 		}
+		free_game(game);
+		return 1;
+	}
+	elapsed = get_time() - start;
+	if (table != NULL) {
+		free_perft_table(table);
 	}
 
-	if (game == NULL || results == NULL) {
-		fputs("Failed to initialize variables\n", stderr);
+	print_results(options, results, breakdown);
+
+	nodes = 0;
+	for (int i = 0; i < level; ++i) {
+		nodes += results[i];
+	}
+	fprintf(stderr, "%llu nodes in %.3fs (%.0f nodes/s)\n", nodes, elapsed,
+			elapsed > 0 ? nodes / elapsed : 0);
+
+	if (options->check) {
+		unsigned long long *expected;
+		int ret = 0;
+
+		expected = alloca(level * sizeof *expected);
+		memset(expected, 0, level * sizeof *expected);
+		calculate_perft(game, 0, level, expected, pack_move(0, 0, EMPTY), false);
+
+		for (int i = 0; i < level; ++i) {
+			if (results[i] != expected[i]) {
+				fprintf(stderr, "MISMATCH at depth %d: got %llu, oracle says %llu\n",
+						i, results[i], expected[i]);
+				ret = 1;
+			}
+		}
+		if (ret == 0) {
+			fputs("Matches the oracle\n", stderr);
+		}
+		free_game(game);
+		return ret;
+	}
+
+	free_game(game);
+	return 0;
+}
+
+int run_perft_server(struct perft_options *options) {
+	struct perft_table *table;
+	char *line;
+	size_t line_alloc;
+	ssize_t line_len;
+
+	table = NULL;
+	if (options->hash_mb > 0 && (table = new_perft_table(options->hash_mb)) == NULL) {
+		fputs("Failed to allocate hash table\n", stderr);
 		return 1;
 	}
 
-	calculate_perft(game, 0, level, results, 0, 0, 0, 0, autotest);
+	line = NULL;
+	line_alloc = 0;
+	while ((line_len = getline(&line, &line_alloc, stdin)) >= 0) {
+		while (line_len > 0 && (line[line_len - 1] == '\n' || line[line_len - 1] == '\r')) {
+			line[--line_len] = '\0';
+		}
+		if (strcmp(line, "quit") == 0) {
+			break;
+		}
+		if (line_len == 0) {
+			continue;
+		}
+		serve_request(options, line, table);
+		fflush(stdout);
+	}
+
+	free(line);
+	if (table != NULL) {
+		free_perft_table(table);
+	}
+	return 0;
+}
+
+static void serve_request(struct perft_options *options, char *request, struct perft_table *table) {
+	struct perft_options query;
+	unsigned long long *results;
+	struct game *game;
+	char *fen, *moves, *end;
+	int depth, fields;
+
+	depth = strtol(request, &end, 10);
+	if (end == request || *end != ' ' || depth < 1) {
+		puts("error: expected \"depth fen [moves]\"");
+		return;
+	}
+
+	/* the FEN is four fields, maybe followed by the two clocks. Anything
+	 * after that is moves. */
+	fen = ++end;
+	for (fields = 0; *end != '\0'; ++end) {
+		if (*end == ' ' && ++fields >= 4) {
+			char *next = end + 1;
+			if (fields >= 6 || strspn(next, "0123456789") != strcspn(next, " ")) {
+				break;
+			}
+		}
+	}
+	moves = NULL;
+	if (*end != '\0') {
+		*end = '\0';
+		moves = end + 1;
+	}
+
+	if ((game = setup_game(fen, moves)) == NULL) {
+		puts("error: invalid position or moves");
+		return;
+	}
+
+	memcpy(&query, options, sizeof query);
+	query.level = depth + 1;
+	query.autotest = true;
+	results = calloc(query.level, sizeof *results);
+	if (results == NULL || run_fast_perft(game, &query, results, NULL, table) < 0) {
+		puts("error: failed to run perft test");
+	}
+	else {
+		print_results(&query, results, NULL);
+	}
 
+	free(results);
 	free_game(game);
+}
 
-	if (!autotest) {
-		for (int i = 0; i < level; ++i) {
+void count_perft(struct game *game, int level, unsigned long long *results) {
+	memset(results, 0, level * sizeof *results);
+	if (level > 0) {
+		fast_perft(game, 0, level, results, NULL);
+	}
+}
+
+static struct game *setup_game(char *start_pos, char *start_sequence) {
+	struct game *game;
+
+	if ((game = new_game()) == NULL) {
+		fputs("Failed to initialize variables\n", stderr);
+		return NULL;
+	}
+
+	if (start_pos != NULL) {
+		if (init_game(game, start_pos)) {
+			fputs("Failed to initialize game\n", stderr);
+			free_game(game);
+			return NULL;
+		}
+	}
+
+	if (start_sequence != NULL) {
+		if (run_sequence(game, start_sequence) != 0) {
+			free_game(game);
+			return NULL;
+		}
+	}
+
+	return game;
+}
+
+static void print_results(struct perft_options *options, unsigned long long *results,
+		struct perft_breakdown *breakdown) {
+	if (breakdown != NULL) {
+		puts("depth nodes captures e.p. castles promotions checks discovered double checkmates");
+		for (int i = 0; i < options->level; ++i) {
+			printf("%d %llu %llu %llu %llu %llu %llu %llu %llu %llu\n", i, results[i],
+					breakdown[i].captures, breakdown[i].en_pessants,
+					breakdown[i].castles, breakdown[i].promotions,
+					breakdown[i].checks, breakdown[i].discovered_checks,
+					breakdown[i].double_checks, breakdown[i].checkmates);
+		}
+	}
+	else if (!options->autotest) {
+		for (int i = 0; i < options->level; ++i) {
 			printf("%llu\n", results[i]);
 		}
 	}
 	else {
 		putchar('\n');
-		printf("%llu\n", results[level-1]);
+		printf("%llu\n", results[options->level-1]);
 	}
-
-	return 0;
 }
 
 static int run_sequence(struct game *game, char *sequence) {
@@ -85,8 +387,13 @@ static int run_sequence(struct game *game, char *sequence) {
 			buff[j] = sequence[i+j];
 		}
 		buff[j] = '\0';
-		if (parse_move(&move, buff) < 0 ||
-		    make_move(game, &move) < 0) {
+		if (parse_move(&move, buff) < 0) {
+			return 1;
+		}
+		/* a game that's over can still be counted, only illegal moves
+		 * are errors */
+		switch (make_move(game, &move)) {
+		case NONFATAL_ERROR:
 			return 1;
 		}
 		i += j;
@@ -98,7 +405,7 @@ static int run_sequence(struct game *game, char *sequence) {
 }
 
 static void calculate_perft(struct game *game, int curr_depth, int max_depth, unsigned long long *results,
-		int r_pi, int c_pi, int r_pf, int c_pf, bool autotest) {
+		struct move parent, bool autotest) {
 	unsigned long long old_depth;
 
 	if (curr_depth >= max_depth) {
@@ -117,13 +424,10 @@ static void calculate_perft(struct game *game, int curr_depth, int max_depth, un
 	 * out bugs in my engine, not to efficiently calculate perft values. I
 	 * could do a lot of pruning, but that would be testing the test
 	 * function, and not the real function. */
-	for (int r_i = 0; r_i < 8; r_i++) {
-		for (int c_i = 0; c_i < 8; c_i++) {
-			for (int r_f = 0; r_f < 8; ++r_f) {
-				for (int c_f = 0; c_f < 8; ++c_f) {
-					add_node(game, curr_depth, max_depth, results, r_i, c_i, r_f, c_f, EMPTY, autotest);
-				}
-			}
+	for (int from = 0; from < 64; ++from) {
+		for (int to = 0; to < 64; ++to) {
+			add_node(game, curr_depth, max_depth, results,
+					pack_move(from, to, EMPTY), autotest);
 		}
 	}
 
@@ -133,46 +437,399 @@ static void calculate_perft(struct game *game, int curr_depth, int max_depth, un
 		if (diff == 0) {
 			return;
 		}
-		print_move(r_pi, c_pi, r_pf, c_pf, diff);
+		print_move(parent, diff);
 	}
 }
 static void add_node(struct game *game, int curr_depth, int max_depth, unsigned long long *results,
-		int r_i, int c_i, int r_f, int c_f, enum piece_type promotion, bool autotest) {
-	struct move move;
+		struct move move, bool autotest) {
 	struct game backup;
 	int code;
 
 	memcpy(&backup, game, sizeof backup);
 
-	move.r_i = r_i;
-	move.c_i = c_i;
-	move.r_f = r_f;
-	move.c_f = c_f;
-	move.promotion = promotion;
-
 	code = make_move(&backup, &move);
 
 	switch (code) {
 	case ILLEGAL_MOVE:
 		return;
-	case BLACK_WIN: case WHITE_WIN: case FORCED_DRAW:
+	case BLACK_WIN: case WHITE_WIN:
 		++results[curr_depth+1];
 		return;
 	case MISSING_PROMOTION:
-		if (promotion != EMPTY) {
+		if (move_promotion(move) != EMPTY) {
 			fputs("ENGINE ERROR!!! make_move() returned MISSING_PROMOTION on non-empty promotion type\n", stderr);
 			exit(EXIT_FAILURE);
 		}
-		add_node(&backup, curr_depth, max_depth, results, r_i, c_i, r_f, c_f, ROOK, autotest);
-		add_node(&backup, curr_depth, max_depth, results, r_i, c_i, r_f, c_f, KNIGHT, autotest);
-		add_node(&backup, curr_depth, max_depth, results, r_i, c_i, r_f, c_f, BISHOP, autotest);
-		add_node(&backup, curr_depth, max_depth, results, r_i, c_i, r_f, c_f, QUEEN, autotest);
+		for (enum piece_type p = ROOK; p <= QUEEN; ++p) {
+			add_node(&backup, curr_depth, max_depth, results,
+					pack_move(move_from(move), move_to(move), p), autotest);
+		}
 		break;
+	/* perft counts positions, not finished games, so play on through
+	 * draws. A stalemate just has no moves to count. */
 	default:
-		calculate_perft(&backup, curr_depth+1, max_depth, results, r_i, c_i, r_f, c_f, autotest);
+		calculate_perft(&backup, curr_depth+1, max_depth, results, move, autotest);
+	}
+}
+
+static void fast_perft(struct game *game, int curr_depth, int max_depth, unsigned long long *results,
+		struct perft_breakdown *breakdown) {
+	struct move moves[MAX_MOVES];
+	int move_count;
+
+	++results[curr_depth];
+	if (curr_depth + 1 >= max_depth) {
+		return;
+	}
+
+	move_count = generate_legal_moves(game, moves);
+	if (breakdown != NULL) {
+		count_breakdown(game, moves, move_count, &breakdown[curr_depth + 1]);
+	}
+
+	/* bulk counting, every legal move is a leaf */
+	if (curr_depth + 2 >= max_depth) {
+		results[curr_depth + 1] += move_count;
+		return;
+	}
+
+	for (int i = 0; i < move_count; ++i) {
+		struct undo undo;
+		do_move(game, &moves[i], &undo);
+		fast_perft(game, curr_depth + 1, max_depth, results, breakdown);
+		undo_move(game, &moves[i], &undo);
+	}
+}
+
+static void count_breakdown(struct game *game, struct move *moves, int move_count,
+		struct perft_breakdown *breakdown) {
+	struct board *board = &game->board;
+	struct check_info info;
+	unsigned long long captures;
+	uint64_t enemy, interesting[PAWN + 1];
+	int en_pessant;
+
+	find_check_info(game, &info);
+	enemy = board->players[get_player(game) == WHITE ? BLACK : WHITE];
+	en_pessant = board->en_pessant;
+
+	/* this runs on every leaf. Captures are counted without branching,
+	 * and everything else is only looked at for moves that land somewhere
+	 * they could be special or give check */
+	memcpy(interesting, info.squares, sizeof interesting);
+	interesting[PAWN] |= 0xff000000000000ffull;
+	if (en_pessant != -1) {
+		interesting[PAWN] |= SQUARE_BIT(en_pessant);
+	}
+	interesting[KING] |= SQUARE_BIT(SQUARE(0, 2)) | SQUARE_BIT(SQUARE(0, 6)) |
+		SQUARE_BIT(SQUARE(7, 2)) | SQUARE_BIT(SQUARE(7, 6));
+	captures = 0;
+	for (int i = 0; i < move_count; ++i) {
+		struct move *move = &moves[i];
+		int from = move_from(*move);
+		int to = move_to(*move);
+		enum piece_type type = CODE_TYPE(board->squares[from]);
+		bool special = false;
+		int checks;
+
+		captures += enemy >> to & 1;
+		if (!(interesting[type] & SQUARE_BIT(to)) &&
+		    !(info.discoverers & SQUARE_BIT(from))) {
+			continue;
+		}
+
+		if (type == PAWN && to == en_pessant) {
+			++breakdown->en_pessants;
+			++captures;
+			special = true;
+		}
+		if (move_promotion(*move) != EMPTY) {
+			++breakdown->promotions;
+			special = true;
+		}
+		if (type == KING && abs(SQUARE_COL(to) - SQUARE_COL(from)) == 2) {
+			++breakdown->castles;
+			special = true;
+		}
+
+		/* a pawn reaching the last row without promoting, or a king
+		 * stepping onto a castling square, isn't special after all */
+		if (!special && !(info.squares[type] & SQUARE_BIT(to)) &&
+		    !(info.discoverers & SQUARE_BIT(from))) {
+			continue;
+		}
+		if ((checks = gives_check(game, &info, move)) == 0) {
+			continue;
+		}
+
+		++breakdown->checks;
+		/* published tables count double checks apart from discovered
+		 * ones */
+		if (checks == DISCOVERED_CHECK) {
+			++breakdown->discovered_checks;
+		}
+		else if (checks == (DIRECT_CHECK | DISCOVERED_CHECK)) {
+			++breakdown->double_checks;
+		}
+
+		/* checks are rare enough that it's fine to actually play them
+		 * and look for a way out */
+		{
+			struct undo undo;
+			do_move(game, move, &undo);
+			if (!has_check_evasion(game)) {
+				++breakdown->checkmates;
+			}
+			undo_move(game, move, &undo);
+		}
+	}
+
+	breakdown->captures += captures;
+}
+
+static int run_fast_perft(struct game *game, struct perft_options *options, unsigned long long *results,
+		struct perft_breakdown *breakdown, struct perft_table *table) {
+	struct move moves[MAX_MOVES];
+	struct perft_job job;
+	struct perft_task task;
+	struct pool *pool;
+	int threads = options->threads;
+	int ret = -1;
+
+	++results[0];
+	if (options->level < 2) {
+		return 0;
+	}
+
+	job.level = options->level;
+	job.root_moves = generate_legal_moves(game, moves);
+	atomic_init(&job.failed, false);
+	job.results = calloc((size_t) threads * job.level, sizeof *job.results);
+	job.root_leaves = calloc((size_t) threads * job.root_moves + 1, sizeof *job.root_leaves);
+	job.stats = calloc(threads, sizeof *job.stats);
+	job.table = table;
+	job.breakdown = NULL;
+	pool = new_pool(threads, sizeof task, run_perft_task, &job);
+	if (job.results == NULL || job.root_leaves == NULL || job.stats == NULL || pool == NULL) {
+		goto end;
+	}
+	if (breakdown != NULL) {
+		if ((job.breakdown = calloc((size_t) threads * job.level, sizeof *job.breakdown)) == NULL) {
+			goto end;
+		}
+		count_breakdown(game, moves, job.root_moves, &job.breakdown[1]);
+	}
+
+	for (int i = 0; i < job.root_moves; ++i) {
+		struct undo undo;
+
+		if (job.level == 2) {
+			job.root_leaves[i] = 1;
+			continue;
+		}
+
+		/* the threads don't need the history, and they can't share it */
+		memcpy(&task.game, game, sizeof task.game);
+		task.game.history = NULL;
+		do_move(&task.game, &moves[i], &undo);
+		task.depth = 1;
+		task.root = i;
+		if (pool_push(pool, i % threads, &task) < 0) {
+			goto end;
+		}
+	}
+
+	if (pool_run(pool) < 0 || job.failed) {
+		goto end;
+	}
+
+	/* added up in a fixed order so that the output doesn't depend on which
+	 * thread did what */
+	for (int i = 0; i < threads; ++i) {
+		for (int j = 0; j < job.level; ++j) {
+			results[j] += job.results[i * job.level + j];
+		}
+		for (int j = 0; j < job.root_moves && i > 0; ++j) {
+			job.root_leaves[j] += job.root_leaves[i * job.root_moves + j];
+		}
+		for (int j = 0; j < job.level && breakdown != NULL; ++j) {
+			struct perft_breakdown *from = &job.breakdown[i * job.level + j];
+			breakdown[j].captures += from->captures;
+			breakdown[j].en_pessants += from->en_pessants;
+			breakdown[j].castles += from->castles;
+			breakdown[j].promotions += from->promotions;
+			breakdown[j].checks += from->checks;
+			breakdown[j].discovered_checks += from->discovered_checks;
+			breakdown[j].double_checks += from->double_checks;
+			breakdown[j].checkmates += from->checkmates;
+		}
+	}
+	if (job.level == 2) {
+		results[1] = job.root_moves;
+	}
+
+	/* the server answers many requests, don't fill its stderr */
+	if (job.table != NULL && !options->server) {
+		struct hash_stats total = { 0, 0 };
+		for (int i = 0; i < threads; ++i) {
+			total.probes += job.stats[i].probes;
+			total.hits += job.stats[i].hits;
+		}
+		fprintf(stderr, "hash: %llu probes, %llu hits (%.1f%%), %llu entries\n",
+				total.probes, total.hits,
+				total.probes > 0 ? 100.0 * total.hits / total.probes : 0,
+				(unsigned long long) job.table->mask + 1);
+	}
+
+	if (options->autotest) {
+		for (int i = 0; i < job.root_moves; ++i) {
+			/* the oracle skips moves with no leaves under them */
+			if (job.root_leaves[i] == 0) {
+				continue;
+			}
+			print_move(moves[i], job.root_leaves[i]);
+		}
+	}
+
+	ret = 0;
+end:
+	if (pool != NULL) {
+		free_pool(pool);
+	}
+	free(job.breakdown);
+	free(job.stats);
+	free(job.results);
+	free(job.root_leaves);
+	return ret;
+}
+
+static void run_perft_task(struct pool *pool, int worker, void *task, void *aux) {
+	struct perft_task *curr = task;
+	struct perft_job *job = aux;
+	unsigned long long *results = job->results + (size_t) worker * job->level;
+	struct perft_breakdown *breakdown = NULL;
+	unsigned long long old_leaves;
+
+	if (job->breakdown != NULL) {
+		breakdown = job->breakdown + (size_t) worker * job->level;
+	}
+
+	/* hand the children out to the idle threads instead of doing the
+	 * whole subtree here */
+	if (job->level - curr->depth >= SPLIT_DEPTH && pool_idle(pool) > 0) {
+		struct move moves[MAX_MOVES];
+		struct perft_task child;
+		int move_count;
+
+		++results[curr->depth];
+		move_count = generate_legal_moves(&curr->game, moves);
+		if (breakdown != NULL) {
+			count_breakdown(&curr->game, moves, move_count, &breakdown[curr->depth + 1]);
+		}
+		for (int i = 0; i < move_count; ++i) {
+			struct undo undo;
+
+			memcpy(&child, curr, sizeof child);
+			do_move(&child.game, &moves[i], &undo);
+			++child.depth;
+			if (pool_push(pool, worker, &child) < 0) {
+				atomic_store(&job->failed, true);
+			}
+		}
+		return;
 	}
+
+	old_leaves = results[job->level - 1];
+	if (job->table != NULL) {
+		/* the table only knows about leaves, so count each level under
+		 * this one separately. The last level costs far more than the
+		 * others put together. */
+		++results[curr->depth];
+		for (int depth = 1; curr->depth + depth < job->level; ++depth) {
+			results[curr->depth + depth] += hashed_perft(job->table, &curr->game,
+					depth, &job->stats[worker]);
+		}
+	}
+	else {
+		fast_perft(&curr->game, curr->depth, job->level, results, breakdown);
+	}
+	job->root_leaves[(size_t) worker * job->root_moves + curr->root] +=
+		results[job->level - 1] - old_leaves;
+}
+
+static struct perft_table *new_perft_table(long megabytes) {
+	struct perft_table *ret;
+	size_t entries;
+
+	/* round down to a power of two so that indexing is just a mask */
+	entries = 1;
+	while (entries * 2 * sizeof *ret->entries <= (size_t) megabytes << 20) {
+		entries *= 2;
+	}
+
+	if ((ret = malloc(sizeof *ret)) == NULL) {
+		return NULL;
+	}
+	if ((ret->entries = calloc(entries, sizeof *ret->entries)) == NULL) {
+		free(ret);
+		return NULL;
+	}
+	ret->mask = entries - 1;
+	return ret;
+}
+
+static void free_perft_table(struct perft_table *table) {
+	free(table->entries);
+	free(table);
+}
+
+static unsigned long long hashed_perft(struct perft_table *table, struct game *game, int depth,
+		struct hash_stats *stats) {
+	struct move moves[MAX_MOVES];
+	struct perft_entry *entry;
+	uint64_t key, check, count;
+	int move_count;
+
+	if (depth <= 1) {
+		return generate_legal_moves(game, moves);
+	}
+
+	/* the same position has a different count at every depth */
+	key = game->key ^ (depth * 0x9e3779b97f4a7c15);
+	entry = &table->entries[key & table->mask];
+
+	++stats->probes;
+	check = atomic_load_explicit(&entry->check, memory_order_relaxed);
+	count = atomic_load_explicit(&entry->count, memory_order_relaxed);
+	/* empty entries are all zeroes, zero counts are never stored */
+	if (count != 0 && (check ^ count) == key) {
+		++stats->hits;
+		return count;
+	}
+
+	count = 0;
+	move_count = generate_legal_moves(game, moves);
+	for (int i = 0; i < move_count; ++i) {
+		struct undo undo;
+		do_move(game, &moves[i], &undo);
+		count += hashed_perft(table, game, depth - 1, stats);
+		undo_move(game, &moves[i], &undo);
+	}
+
+	if (count != 0) {
+		atomic_store_explicit(&entry->check, key ^ count, memory_order_relaxed);
+		atomic_store_explicit(&entry->count, count, memory_order_relaxed);
+	}
+	return count;
+}
+
+static double get_time(void) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec + now.tv_nsec / 1e9;
 }
 
-static void print_move(int ri, int ci, int rf, int cf, unsigned long long diff) {
-	printf("%c%d%c%d %llu\n", ci+'a', 8 - ri, cf+'a', 8 - rf, diff);
+static void print_move(struct move move, unsigned long long diff) {
+	char text[MOVE_STRING_SIZE];
+	printf("%s %llu\n", move_to_string(&move, text), diff);
 }
@@ -0,0 +1,272 @@
+/* chessh - chess over ssh
+ * Copyright (C) 2024  Nate Choe <nate@natechoe.dev>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * */
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include <client/pool.h>
+
+struct queue {
+	pthread_mutex_t lock;
+	char *tasks;
+	/* the tasks are tasks[head..tail), the owner takes them from the tail and
+	 * thieves from the head, where the oldest (and biggest) tasks are */
+	size_t head;
+	size_t tail;
+	size_t alloc;
+};
+
+struct worker {
+	struct pool *pool;
+	int id;
+	pthread_t thread;
+};
+
+struct pool {
+	int threads;
+	size_t task_size;
+	pool_fn run;
+	void *aux;
+
+	struct queue *queues;
+	struct worker *workers;
+
+	/* tasks that have been pushed but haven't finished yet */
+	atomic_long pending;
+	atomic_int idle;
+
+	/* idle threads sleep on `wake` until something is pushed or the last
+	 * task finishes. `pushes` counts every push, so a thread can tell if
+	 * one came in while it was looking through the queues. */
+	atomic_ulong pushes;
+	pthread_mutex_t wait_lock;
+	pthread_cond_t wake;
+};
+
+static void *run_worker(void *arg);
+
+/* wakes every sleeping thread */
+static void wake_all(struct pool *pool);
+
+/* takes a task off of the tail (if `steal` is false) or the head of `queue`
+ * and copies it into `task`. Returns false if the queue was empty. */
+static bool take_task(struct pool *pool, struct queue *queue, void *task, bool steal);
+
+struct pool *new_pool(int threads, size_t task_size, pool_fn run, void *aux) {
+	struct pool *ret;
+
+	if (threads < 1 || (ret = malloc(sizeof *ret)) == NULL) {
+		return NULL;
+	}
+	ret->threads = threads;
+	ret->task_size = task_size;
+	ret->run = run;
+	ret->aux = aux;
+	atomic_init(&ret->pending, 0);
+	atomic_init(&ret->idle, 0);
+	atomic_init(&ret->pushes, 0);
+
+	ret->queues = calloc(threads, sizeof *ret->queues);
+	ret->workers = calloc(threads, sizeof *ret->workers);
+	if (ret->queues == NULL || ret->workers == NULL) {
+		free(ret->queues);
+		free(ret->workers);
+		free(ret);
+		return NULL;
+	}
+
+	pthread_mutex_init(&ret->wait_lock, NULL);
+	pthread_cond_init(&ret->wake, NULL);
+	for (int i = 0; i < threads; ++i) {
+		pthread_mutex_init(&ret->queues[i].lock, NULL);
+		ret->workers[i].pool = ret;
+		ret->workers[i].id = i;
+	}
+
+	return ret;
+}
+
+void free_pool(struct pool *pool) {
+	for (int i = 0; i < pool->threads; ++i) {
+		pthread_mutex_destroy(&pool->queues[i].lock);
+		free(pool->queues[i].tasks);
+	}
+	pthread_mutex_destroy(&pool->wait_lock);
+	pthread_cond_destroy(&pool->wake);
+	free(pool->queues);
+	free(pool->workers);
+	free(pool);
+}
+
+int pool_push(struct pool *pool, int worker, void *task) {
+	struct queue *queue = &pool->queues[worker];
+	int ret = 0;
+
+	pthread_mutex_lock(&queue->lock);
+	if (queue->tail >= queue->alloc) {
+		/* slide everything back to the start before growing */
+		if (queue->head > 0) {
+			memmove(queue->tasks, queue->tasks + queue->head * pool->task_size,
+					(queue->tail - queue->head) * pool->task_size);
+			queue->tail -= queue->head;
+			queue->head = 0;
+		}
+		if (queue->tail >= queue->alloc) {
+			size_t new_alloc = queue->alloc == 0 ? 64 : queue->alloc * 2;
+			char *new_tasks = realloc(queue->tasks, new_alloc * pool->task_size);
+			if (new_tasks == NULL) {
+				ret = -1;
+				goto end;
+			}
+			queue->tasks = new_tasks;
+			queue->alloc = new_alloc;
+		}
+	}
+
+	memcpy(queue->tasks + queue->tail * pool->task_size, task, pool->task_size);
+	++queue->tail;
+	atomic_fetch_add(&pool->pending, 1);
+end:
+	pthread_mutex_unlock(&queue->lock);
+
+	/* a thread only sleeps after counting itself as idle, so if none are
+	 * idle then none need waking */
+	if (ret == 0) {
+		atomic_fetch_add(&pool->pushes, 1);
+		if (atomic_load(&pool->idle) > 0) {
+			wake_all(pool);
+		}
+	}
+	return ret;
+}
+
+int pool_run(struct pool *pool) {
+	int started;
+
+	/* the calling thread does worker 0's share */
+	for (started = 1; started < pool->threads; ++started) {
+		if (pthread_create(&pool->workers[started].thread, NULL,
+					run_worker, &pool->workers[started]) != 0) {
+			/* the threads that did start will just have to
+			 * do more */
+			break;
+		}
+	}
+
+	run_worker(&pool->workers[0]);
+
+	for (int i = 1; i < started; ++i) {
+		pthread_join(pool->workers[i].thread, NULL);
+	}
+
+	/* only left over if no thread managed to run at all */
+	return atomic_load(&pool->pending) == 0 ? 0 : -1;
+}
+
+int pool_idle(struct pool *pool) {
+	return atomic_load_explicit(&pool->idle, memory_order_relaxed);
+}
+
+static void *run_worker(void *arg) {
+	struct worker *worker = arg;
+	struct pool *pool = worker->pool;
+	void *task;
+	bool idle = false;
+
+	if ((task = malloc(pool->task_size)) == NULL) {
+		return NULL;
+	}
+
+	for (;;) {
+		unsigned long pushes;
+		bool found;
+
+		pushes = atomic_load(&pool->pushes);
+		found = take_task(pool, &pool->queues[worker->id], task, false);
+		for (int i = 1; !found && i < pool->threads; ++i) {
+			found = take_task(pool, &pool->queues[(worker->id + i) % pool->threads],
+					task, true);
+		}
+
+		if (!found) {
+			bool done;
+
+			if (!idle) {
+				atomic_fetch_add(&pool->idle, 1);
+				idle = true;
+				/* look again now that pool_push() knows to wake
+				 * this thread */
+				continue;
+			}
+
+			/* the running tasks may still push more, so wait for
+			 * that or for the last of them to finish */
+			pthread_mutex_lock(&pool->wait_lock);
+			while (atomic_load(&pool->pushes) == pushes &&
+					atomic_load(&pool->pending) != 0) {
+				pthread_cond_wait(&pool->wake, &pool->wait_lock);
+			}
+			done = atomic_load(&pool->pending) == 0;
+			pthread_mutex_unlock(&pool->wait_lock);
+			if (done) {
+				break;
+			}
+			continue;
+		}
+
+		if (idle) {
+			atomic_fetch_sub(&pool->idle, 1);
+			idle = false;
+		}
+		pool->run(pool, worker->id, task, pool->aux);
+		if (atomic_fetch_sub(&pool->pending, 1) == 1) {
+			wake_all(pool);
+		}
+	}
+
+	if (idle) {
+		atomic_fetch_sub(&pool->idle, 1);
+	}
+	free(task);
+	return NULL;
+}
+
+static void wake_all(struct pool *pool) {
+	/* taking the lock means that no thread is between checking its
+	 * condition and going to sleep */
+	pthread_mutex_lock(&pool->wait_lock);
+	pthread_cond_broadcast(&pool->wake);
+	pthread_mutex_unlock(&pool->wait_lock);
+}
+
+static bool take_task(struct pool *pool, struct queue *queue, void *task, bool steal) {
+	bool ret = false;
+
+	pthread_mutex_lock(&queue->lock);
+	if (queue->head < queue->tail) {
+		size_t index = steal ? queue->head++ : --queue->tail;
+		memcpy(task, queue->tasks + index * pool->task_size, pool->task_size);
+		if (queue->head == queue->tail) {
+			queue->head = queue->tail = 0;
+		}
+		ret = true;
+	}
+	pthread_mutex_unlock(&queue->lock);
+	return ret;
+}
@@ -40,6 +40,7 @@ int run_client(char *sock_path) {
 	enum player player;
 	int recvlen;
 	ssize_t pidlen;
+	struct game_storage storage;
 	struct game *game;
 	struct frontend *frontend;
 	int end_msg;
@@ -74,7 +75,8 @@ int run_client(char *sock_path) {
 	frontend->report_msg(frontend->aux, player == WHITE ?
 			MSG_FOUND_OP_WHITE: MSG_FOUND_OP_BLACK);
 
-	game = new_game();
+	/* nothing is allocated once the game starts */
+	game = init_game_storage(&storage);
 
 	frontend->display_board(frontend->aux, game, player);
 	for (;;) {
@@ -106,6 +108,10 @@ int run_client(char *sock_path) {
 			end_msg = MSG_UNKNOWN_ERROR;
 			goto end;
 		}
+		/* there's no way to claim the draw yet, so the game goes on */
+		if (move_code == DRAW_OFFER) {
+			frontend->report_msg(frontend->aux, MSG_DRAW_OFFER);
+		}
 
 		frontend->display_board(frontend->aux, game, player);
 	}
@@ -117,58 +123,44 @@ end:
 }
 
 static int parse_op_move(struct frontend *frontend, struct game *game, int fd) {
-	char buff[1024];
 	int code;
-	ssize_t read_len;
 	struct move move;
-	if ((read_len = read(fd, buff, sizeof buff)) < 5) {
-		return IO_ERROR;
-	}
-	if (buff[read_len-1] != '\0') {
+	/* both ends are this program, so the packed move goes over as is */
+	if (read(fd, &move, sizeof move) != (ssize_t) sizeof move) {
 		return IO_ERROR;
 	}
-	if ((code = parse_move(&move, buff)) < 0 ||
-	    (code = make_move(game, &move)) < 0) {
+	if ((code = make_move(game, &move)) < 0) {
 		return code;
 	}
 	frontend->report_event(EVENT_OP_MOVE, frontend->aux, game, &move);
-	return 0;
+	return code;
 }
 
 static int get_player_move(struct frontend *frontend, struct game *game, int peer) {
-	char *move_text;
 	int move_code;
 	struct move move;
-	ssize_t move_text_len;
 	frontend->report_msg(frontend->aux, MSG_WAITING_FOR_MOVE);
 	for (;;) {
-		move_text = frontend->get_move(frontend->aux, game, get_player(game));
-		if (move_text == NULL) {
+		if (frontend->get_move(frontend->aux, game, get_player(game), &move) < 0) {
 			return IO_ERROR;
 		}
-		if (((move_code = parse_move(&move, move_text)) < 0 ||
-		     (move_code = make_move(game, &move)) < 0) &&
-		     (move_code != ILLEGAL_MOVE &&
-		      move_code != MISSING_PROMOTION)) {
+		if ((move_code = make_move(game, &move)) < 0 &&
+		    move_code != ILLEGAL_MOVE &&
+		    move_code != MISSING_PROMOTION) {
 			return move_code;
 		}
 		switch (move_code) {
 		case ILLEGAL_MOVE:
 			frontend->report_msg(frontend->aux, MSG_ILLEGAL_MOVE);
-			free(move_text);
 			continue;
 		case MISSING_PROMOTION:
 			frontend->report_error(frontend->aux, MISSING_PROMOTION);
-			free(move_text);
 			continue;
 		}
 		break;
 	}
-	move_text_len = (ssize_t) strlen(move_text)+1;
-	if (write(peer, move_text, move_text_len) < move_text_len) {
-		free(move_text);
+	if (write(peer, &move, sizeof move) != (ssize_t) sizeof move) {
 		return IO_ERROR;
 	}
-	free(move_text);
 	return move_code;
 }
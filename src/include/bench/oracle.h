@@ -0,0 +1,76 @@
+/* chessh - chess over ssh
+ * Copyright (C) 2024  Nate Choe <nate@natechoe.dev>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * */
+
+/* The original 8x8 engine, kept around as the fuzzer's reference. It checks
+ * every move by probing the board square by square and tracks castling and en
+ * pessant with per-piece move counters, so it shares no code with the engine
+ * it's checking. Only the piece and player enums come from client/chess.h. */
+
+#ifndef HAVE_BENCH__ORACLE
+#define HAVE_BENCH__ORACLE
+
+#include <stdbool.h>
+
+#include <client/chess.h>
+
+struct oracle_piece {
+	enum piece_type type;
+	enum player player;
+	int moves; /* total no. of times this piece has moved */
+	int last_move; /* last time this piece has moved */
+};
+
+struct oracle_game {
+	/* board[0][N] = first row black
+	 * board[1][N] = second row black
+	 * board[0][3] = black queen
+	 *
+	 * Basically in reading order from white's perspective */
+	struct oracle_piece board[8][8];
+	int duration; /* no. of turns played, includes both black and white's
+			 moves */
+};
+
+struct oracle_move {
+	/* initial row/column */
+	int r_i;
+	int c_i;
+
+	/* final row/column */
+	int r_f;
+	int c_f;
+
+	/* promote to this piece, if valid. if unspecified, set to EMPTY */
+	enum piece_type promotion;
+};
+
+/* 0 on success, -1 on failure, uses Forsyth-Edwards Notation. The clocks are
+ * checked but otherwise ignored. */
+extern int oracle_init_game(struct oracle_game *game, char *state);
+
+/* returns ILLEGAL_MOVE, MISSING_PROMOTION, WHITE_WIN or BLACK_WIN for a
+ * checkmate, FORCED_DRAW for a stalemate, and 0 otherwise. The game is only
+ * changed if the move is legal. There are no draws by rule. */
+extern int oracle_make_move(struct oracle_game *game, struct oracle_move *move);
+
+/* like oracle_make_move(), but doesn't look for checkmate or stalemate, which
+ * is much faster */
+extern int oracle_try_move(struct oracle_game *game, struct oracle_move *move);
+
+extern enum player oracle_get_player(struct oracle_game *game);
+
+#endif
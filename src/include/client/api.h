@@ -0,0 +1,51 @@
+/* chessh - chess over ssh
+ * Copyright (C) 2024  Nate Choe <nate@natechoe.dev>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * */
+#ifndef HAVE_CLIENT__API
+#define HAVE_CLIENT__API
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include <client/chess.h>
+
+/* writes the board to stdout in a BOARD_INFO reply's format */
+extern void api_send_board(struct game *game);
+
+/* writes a MOVE_BITMAP reply to stdout, for the piece on `sq` */
+extern void api_send_moves_from(struct game *game, int sq);
+
+/* writes every legal move into `buff` as two byte wire moves, the way a
+ * MOVE_INFO reply lists them. Returns the number of moves written. */
+extern int count_valid_moves(struct game *game, char *buff, int buff_size);
+
+/* a whole MOVE_INFO reply, kept until the game moves on so that a client
+ * asking again costs a single write */
+struct move_cache {
+	bool valid;
+	/* the position the reply is for */
+	uint64_t key;
+	uint16_t duration;
+
+	int length;
+	/* the command, the move count and the moves */
+	char reply[3 + MAX_MOVES*2];
+};
+
+/* writes a MOVE_INFO reply to stdout, from `cache` if it's for this position */
+extern void api_send_valid_moves(struct move_cache *cache, struct game *game);
+
+#endif
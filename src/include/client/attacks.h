@@ -0,0 +1,115 @@
+/* chessh - chess over ssh
+ * Copyright (C) 2024  Nate Choe <nate@natechoe.dev>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * */
+
+
+#ifndef HAVE_CLIENT__ATTACKS
+#define HAVE_CLIENT__ATTACKS
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Precomputed attack sets, indexed by square. Squares and bitboards are
+ * numbered the same way as in chess.h.
+ *
+ * Rooks and bishops use magic bitboards, multiplying the blockers by a magic
+ * number gives a perfect hash of everything that matters to that square.
+ *
+ * https://www.chessprogramming.org/Magic_Bitboards */
+
+struct magic {
+	uint64_t mask; /* squares that can block this piece, minus the edges */
+	uint64_t magic;
+	uint64_t *attacks;
+	int shift;
+
+	/* the same attacks, indexed by PEXT(occupied, mask) instead. NULL
+	 * unless cpu_has_fast_pext(). */
+	uint64_t *pext_attacks;
+};
+
+extern uint64_t knight_attacks[64];
+extern uint64_t king_attacks[64];
+
+/* pawn_attacks[player][sq] is every square attacked by `player`'s pawn on
+ * `sq`. The same table also answers the reverse question, a `player` piece on
+ * `sq` is attacked by the other player's pawns on pawn_attacks[player][sq]. */
+extern uint64_t pawn_attacks[2][64];
+
+/* between_squares[a][b] is every square strictly between a and b if they're
+ * on the same row, column or diagonal, and empty otherwise.
+ * line_through[a][b] is the entire row, column or diagonal through both
+ * squares, and also empty if they aren't lined up. */
+extern uint64_t between_squares[64][64];
+extern uint64_t line_through[64][64];
+
+extern struct magic rook_magics[64];
+extern struct magic bishop_magics[64];
+
+static inline uint64_t magic_attacks(struct magic *magic, uint64_t occupied) {
+	return magic->attacks[((occupied & magic->mask) * magic->magic) >> magic->shift];
+}
+
+static inline uint64_t rook_attacks(int sq, uint64_t occupied) {
+	return magic_attacks(&rook_magics[sq], occupied);
+}
+
+static inline uint64_t bishop_attacks(int sq, uint64_t occupied) {
+	return magic_attacks(&bishop_magics[sq], occupied);
+}
+
+static inline uint64_t queen_attacks(int sq, uint64_t occupied) {
+	return rook_attacks(sq, occupied) | bishop_attacks(sq, occupied);
+}
+
+#if defined(__x86_64__) && defined(__GNUC__)
+/* BMI2's PEXT packs the blockers into an index by itself, without a magic
+ * multiplication. It can only be used from functions compiled for BMI2, and
+ * only when cpu_has_fast_pext(). chess.c picks those functions at startup. */
+#define HAVE_PEXT
+
+/* checks for BMI2 and the other instructions that BMI2_TARGET functions get
+ * compiled with, on a CPU where PEXT isn't slow. Safe to call from an ifunc
+ * resolver. */
+extern bool cpu_has_fast_pext(void);
+
+#define BMI2_TARGET __attribute__((target("popcnt,bmi,bmi2")))
+
+BMI2_TARGET static inline uint64_t pext_attacks(struct magic *magic, uint64_t occupied) {
+	return magic->pext_attacks[__builtin_ia32_pext_di(occupied, magic->mask)];
+}
+
+BMI2_TARGET static inline uint64_t rook_attacks_pext(int sq, uint64_t occupied) {
+	return pext_attacks(&rook_magics[sq], occupied);
+}
+
+BMI2_TARGET static inline uint64_t bishop_attacks_pext(int sq, uint64_t occupied) {
+	return pext_attacks(&bishop_magics[sq], occupied);
+}
+#else
+#define rook_attacks_pext rook_attacks
+#define bishop_attacks_pext bishop_attacks
+#endif
+
+/* for code that's compiled twice with `pext` as a constant */
+#define ROOK_ATTACKS(pext, sq, occupied) \
+	((pext) ? rook_attacks_pext(sq, occupied) : rook_attacks(sq, occupied))
+#define BISHOP_ATTACKS(pext, sq, occupied) \
+	((pext) ? bishop_attacks_pext(sq, occupied) : bishop_attacks(sq, occupied))
+#define QUEEN_ATTACKS(pext, sq, occupied) \
+	(ROOK_ATTACKS(pext, sq, occupied) | BISHOP_ATTACKS(pext, sq, occupied))
+
+#endif
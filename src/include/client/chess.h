@@ -18,6 +18,8 @@
 #ifndef HAVE_CLIENT__CHESS
 #define HAVE_CLIENT__CHESS
 
+#include <assert.h>
+#include <stdint.h>
 #include <stdbool.h>
 
 enum piece_type {
@@ -35,46 +37,131 @@ enum player {
 	BLACK
 };
 
-struct piece {
-	enum piece_type type;
-	enum player player;
-	int moves; /* total no. of times this piece has moved */
-	int last_move; /* last time this piece has moved */
-};
+/* Squares are numbered in reading order from white's perspective, so square 0
+ * is a8, square 3 is d8 (the black queen), and square 63 is h1. Bit N of a
+ * bitboard refers to square N. */
+#define SQUARE(r, c) ((r) << 3 | (c))
+#define SQUARE_ROW(sq) ((sq) >> 3)
+#define SQUARE_COL(sq) ((sq) & 7)
+#define SQUARE_BIT(sq) ((uint64_t) 1 << (sq))
+
+/* the contents of a single square, same as the API's 4 bit encoding */
+#define PIECE_CODE(player, type) ((player) << 3 | (type))
+#define CODE_TYPE(code) ((enum piece_type) ((code) & 7))
+#define CODE_PLAYER(code) ((enum player) ((code) >> 3))
 
 struct board {
-	/* board[0][N] = first row black
-	 * board[1][N] = second row black
-	 * board[0][3] = black queen
-	 *
-	 * Basically in reading order from white's perspective */
-	struct piece board[8][8];
+	/* pieces[type] and players[player] have a bit set for every square
+	 * holding a piece of that type/owned by that player */
+	uint64_t pieces[6];
+	uint64_t players[2];
+
+	/* squares[SQUARE(r, c)] is the PIECE_CODE of whatever is at row r,
+	 * column c, or EMPTY */
+	uint8_t squares[64];
+
+	/* a combination of the CASTLE_* flags */
+	uint8_t castling;
+
+	/* the square a pawn would move to when capturing en pessant, -1 if no
+	 * pawn can be captured en pessant */
+	int8_t en_pessant;
+};
+
+#define CASTLE_WHITE_KINGSIDE 1
+#define CASTLE_WHITE_QUEENSIDE 2
+#define CASTLE_BLACK_KINGSIDE 4
+#define CASTLE_BLACK_QUEENSIDE 8
+
+/* enough room for every position since the last capture or pawn move, the
+ * game is drawn once that was 150 turns ago */
+#define HISTORY_SIZE 256
+
+/* the keys of every position a game has been in, for spotting repetitions */
+struct history {
+	/* keys[duration % HISTORY_SIZE] is the key of the position after
+	 * `duration` turns */
+	uint64_t keys[HISTORY_SIZE];
+
+	/* the duration the game was set up with, nothing before that is known */
+	uint16_t start;
 };
 
 struct game {
 	struct board board;
-	int duration; /* no. of turns played, includes both black and white's
-			 moves */
-	int last_big_move; /* Last capture/pawn move, for the 50 move rule */
+
+	/* Zobrist hash of the position: piece placement, the player to move,
+	 * castling rights and en pessant. Two games with the same key are (with
+	 * overwhelming probability) in the same position. Kept up to date by
+	 * every function that changes the game. */
+	uint64_t key;
+
+	uint16_t duration; /* no. of turns played, includes both black and
+			      white's moves */
+	uint16_t since_big_move; /* no. of turns since the last capture/pawn
+				    move, for the 50 move rule */
+
+	/* positions seen so far, NULL if repetitions aren't tracked. Copies of
+	 * a game share their original's history, which is fine as long as
+	 * they're played depth first since every entry that can be looked up
+	 * belongs to the position's own ancestors. */
+	struct history *history;
 };
 
+/* a move packed into the API's 16 bit wire encoding (see doc/api.txt), so it
+ * can be stored, sent to the peer or written to the API as is. From the top
+ * bit down:
+ *   6 bits: the initial square
+ *   1 bit:  set if the move has a promotion
+ *   1 bit:  unused, always 0
+ *   6 bits: the final square
+ *   2 bits: the promotion, 0 without one */
 struct move {
-	/* initial row/column */
-	int r_i;
-	int c_i;
+	uint16_t bits;
+};
+
+#define MOVE_HAS_PROMOTION (1 << 9)
+/* the bits a move sent by the server can have, since it never contains a
+ * promotion */
+#define MOVE_SQUARES (0x3f << 10 | 0x3f << 2)
 
-	/* final row/column */
-	int r_f;
-	int c_f;
+/* `promotion` is EMPTY if there isn't one, and otherwise ROOK through QUEEN,
+ * the only pieces that fit in the two bits it gets */
+static inline struct move pack_move(int from, int to, enum piece_type promotion) {
+	struct move ret;
+	ret.bits = (uint16_t) (from << 10 | to << 2);
+	if (promotion != EMPTY) {
+		assert(promotion >= ROOK && promotion <= QUEEN);
+		ret.bits |= MOVE_HAS_PROMOTION | (promotion & 3);
+	}
+	return ret;
+}
 
-	/* promote to this piece, if valid. if unspecified by the user, set to
-	 * EMPTY */
-	enum piece_type promotion;
+static inline int move_from(struct move move) {
+	return move.bits >> 10;
+}
+
+static inline int move_to(struct move move) {
+	return move.bits >> 2 & 0x3f;
+}
+
+static inline enum piece_type move_promotion(struct move move) {
+	return (move.bits & MOVE_HAS_PROMOTION) ? (enum piece_type) (move.bits & 3) : EMPTY;
+}
+
+/* everything a game needs, for keeping one somewhere other than the heap */
+struct game_storage {
+	struct game game;
+	struct history history;
 };
 
 extern struct game *new_game(void);
 extern void free_game(struct game *game);
 
+/* sets up a new game in `storage` without allocating anything, the game must
+ * not be passed to free_game() */
+extern struct game *init_game_storage(struct game_storage *storage);
+
 #define ILLEGAL_MOVE -1
 #define WHITE_WIN -2
 #define BLACK_WIN -3
@@ -88,17 +175,107 @@ extern void free_game(struct game *game);
 /* returns >=0 on success */
 extern int make_move(struct game *game, struct move *move);
 
-/* 0 on success, -1 on failure, uses Forsyth-Edwards Notation
+/* everything that do_move() changes and can't be worked out from the move
+ * itself */
+struct undo {
+	uint64_t key;
+	uint16_t since_big_move;
+	uint8_t castling;
+	int8_t en_pessant;
+
+	uint8_t piece; /* the PIECE_CODE that moved, before any promotion */
+	uint8_t captured; /* the PIECE_CODE that was captured, or EMPTY */
+	int8_t captured_square;
+
+	/* the rook that moved while castling, or -1 */
+	int8_t castle_from;
+	int8_t castle_to;
+};
+
+/* plays a move that is already known to be legal, like one returned by
+ * generate_legal_moves(). Nothing is validated and game over isn't detected.
+ * The move can be taken back by passing the same `undo` to undo_move(), so a
+ * search can keep one `struct undo` per ply instead of copying the game. */
+extern void do_move(struct game *game, struct move *move, struct undo *undo);
+extern void undo_move(struct game *game, struct move *move, struct undo *undo);
+
+/* no legal position has more than 218 moves */
+#define MAX_MOVES 256
+
+/* writes every legal move for the player to move into `out`, which must have
+ * room for MAX_MOVES moves, and returns how many there are. Moves are sorted by
+ * their starting square, then their final square. Promotions are listed once
+ * for each piece that the pawn can promote to. */
+extern int generate_legal_moves(struct game *game, struct move *out);
+
+/* checks if the player to move has a legal move, stopping at the first one
+ * found */
+extern bool has_legal_move(struct game *game);
+
+/* the same as has_legal_move() for a player who's in check, but much cheaper
+ * since it only looks at king moves and at what can take or block the
+ * checker */
+extern bool has_check_evasion(struct game *game);
+
+/* returns every square that the piece on `sq` can legally move to, or 0 if
+ * it doesn't belong to the player to move. Promotions aren't told apart. */
+extern uint64_t legal_moves_from(struct game *game, int sq);
+
+/* what the player to move needs to know to tell which of their moves give
+ * check without making them, see find_check_info() */
+struct check_info {
+	int king; /* the square of the king that could be checked, -1 if none */
+	uint64_t squares[6]; /* squares[type]: where a piece of that type would
+				give check */
+	uint64_t discoverers; /* pieces that give check just by moving off of
+				 the line between the king and a slider */
+};
+
+extern void find_check_info(struct game *game, struct check_info *info);
+
+#define DIRECT_CHECK 1 /* the piece that moved gives check */
+#define DISCOVERED_CHECK 2 /* some other piece gives check */
+
+/* returns a combination of the *_CHECK flags for a legal move, using `info`
+ * from find_check_info() on the same position. In a double check both flags
+ * are set. */
+extern int gives_check(struct game *game, struct check_info *info, struct move *move);
+
+/* 0 on success, -1 on failure, uses Forsyth-Edwards Notation. game->history
+ * must already be NULL or point to a history, which is started over from the
+ * new position.
  *
  * https://en.wikipedia.org/wiki/Forsyth%E2%80%93Edwards_Notation
  * */
 extern int init_game(struct game *game, char *state);
 
+/* the longest FEN that write_fen() can produce, with room to spare */
+#define FEN_SIZE 128
+
+/* the reverse of init_game(), init_game(write_fen(game)) sets up the same
+ * position, clocks included */
+extern void write_fen(struct game *game, char buff[FEN_SIZE]);
+
 extern enum player get_player(struct game *game);
 
+/* computes game->key from scratch */
+extern uint64_t compute_key(struct game *game);
+
+static inline enum piece_type get_piece_type(struct game *game, int r, int c) {
+	return CODE_TYPE(game->board.squares[SQUARE(r, c)]);
+}
+
+static inline enum player get_piece_player(struct game *game, int r, int c) {
+	return CODE_PLAYER(game->board.squares[SQUARE(r, c)]);
+}
+
 extern int parse_move(struct move *ret, char *move);
 
-extern char *move_to_string(struct move *move);
+/* long enough for a move and its promotion, plus the null terminator */
+#define MOVE_STRING_SIZE 6
+
+/* writes the move into `buff` and returns it */
+extern char *move_to_string(struct move *move, char buff[MOVE_STRING_SIZE]);
 extern char piece_to_char(enum piece_type piece);
 
 #endif
@@ -0,0 +1,28 @@
+/* chessh - chess over ssh
+ * Copyright (C) 2024  Nate Choe <nate@natechoe.dev>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * */
+#ifndef HAVE_CLIENT__EPD
+#define HAVE_CLIENT__EPD
+
+#include <client/perft.h>
+
+/* runs every position in the EPD file `options->epd` against its ";D1 20
+ * ;D2 400" style perft counts, spread over `options->threads` threads. With
+ * `options->level` > 0, depths past `options->level - 1` are skipped. Prints a
+ * table of results and returns nonzero if any position failed. */
+extern int run_epd(struct perft_options *options);
+
+#endif
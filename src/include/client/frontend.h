@@ -26,7 +26,9 @@
 #include <client/chess.h>
 
 struct frontend {
-	char *(*get_move)(void *aux, struct game *game, enum player player);
+	/* reads the player's move into `move`, returns -1 on error */
+	int (*get_move)(void *aux, struct game *game, enum player player,
+			struct move *move);
 
 	/* Used for things that the frontend can fix, currently only used when a
 	 * pawn is missing a promotion. The error always refers to the last
@@ -54,6 +56,9 @@ extern char *frontend_strerror(int code);
 #define MSG_ILLEGAL_MOVE 7
 #define MSG_FOUND_OP_WHITE 8
 #define MSG_FOUND_OP_BLACK 9
+/* either player could claim a draw, for the 50 move rule or a threefold
+ * repetition */
+#define MSG_DRAW_OFFER 10
 
 #define EVENT_OP_MOVE 0
 
@@ -20,6 +20,47 @@
 
 #include <stdbool.h>
 
-extern int run_perft(int level, char *start_pos, char *start_sequence, bool autotest);
+#include <client/chess.h>
+
+struct perft_options {
+	int level; /* -1 if no perft test was requested */
+	char *start_pos; /* FEN, NULL for the usual starting position */
+	char *start_sequence; /* moves to play before starting, can be NULL */
+	bool autotest; /* print perftree's divide output instead of totals */
+
+	/* use the move generator and do_move() instead of probing every move
+	 * with make_move() */
+	bool fast;
+
+	/* with `fast`, run the slow perft as well and compare their results */
+	bool check;
+
+	/* with `fast`, the number of threads to use */
+	int threads;
+
+	/* with `fast`, the size of the hash table in MB, 0 for no table */
+	long hash_mb;
+
+	/* with `fast`, count captures, checks, etc. at every level */
+	bool breakdown;
+
+	/* an EPD file of positions to check instead, NULL for none */
+	char *epd;
+
+	/* answer requests on stdin instead, see run_perft_server() */
+	bool server;
+};
+
+extern int run_perft(struct perft_options *options);
+
+/* reads "[depth] [fen] [moves]" lines from stdin, the same arguments that
+ * perftree passes to test/perftree.sh, and answers each one with the fast
+ * perft's autotest output. A hash table (options->hash_mb) is kept between
+ * requests. Stops at EOF or a "quit" line. */
+extern int run_perft_server(struct perft_options *options);
+
+/* fills results[0..level) with the number of positions at each depth under
+ * `game`, using the move generator. The game is left as it was. */
+extern void count_perft(struct game *game, int level, unsigned long long *results);
 
 #endif
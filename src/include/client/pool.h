@@ -0,0 +1,45 @@
+/* chessh - chess over ssh
+ * Copyright (C) 2024  Nate Choe <nate@natechoe.dev>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * */
+#ifndef HAVE_CLIENT__POOL
+#define HAVE_CLIENT__POOL
+
+#include <stddef.h>
+
+/* a fixed set of threads that run fixed-size tasks. Every thread keeps its own
+ * queue of tasks and steals from the others when it runs out. */
+struct pool;
+
+/* runs `task` on thread number `worker`. It may push more tasks. */
+typedef void (*pool_fn)(struct pool *pool, int worker, void *task, void *aux);
+
+/* returns NULL on error */
+extern struct pool *new_pool(int threads, size_t task_size, pool_fn run, void *aux);
+extern void free_pool(struct pool *pool);
+
+/* copies `task` onto the queue of thread number `worker`, returns -1 on error.
+ * Can be called before pool_run() or from inside a task. */
+extern int pool_push(struct pool *pool, int worker, void *task);
+
+/* starts every thread and waits for every task to finish, including the ones
+ * pushed along the way. Returns -1 on error. */
+extern int pool_run(struct pool *pool);
+
+/* returns the number of threads that are out of tasks, a hint that the
+ * running tasks should split up their work */
+extern int pool_idle(struct pool *pool);
+
+#endif
@@ -1,9 +1,86 @@
 #!/bin/sh
 
+# perftree runs this once for every query, as `perftree.sh depth fen [moves]`.
+# Starting a new client each time is most of the cost of a query, so the first
+# one starts a `chessh-client -S` in the background and every query after that
+# is passed to it through a pair of FIFOs. It's restarted whenever the client
+# is rebuilt.
+#
+#   perftree.sh stop     stops the background client
+#
+# PERFTREE_FLAGS is passed to the background client, for example "--hash 64".
+# PERFTREE_SLOW=1 runs the old oracle perft in a new client for every query
+# instead.
+
 LOCATION=$(realpath $(dirname $0))
+CLIENT="$LOCATION/../build/chessh-client"
+STATE="${TMPDIR:-/tmp}/chessh-perftree-$(id -u)"
+
+if [ -n "$PERFTREE_SLOW" ] ; then
+	if [ $# -lt 3 ] ; then
+		exec "$CLIENT" -a -t `expr $1 + 1` -i "$2"
+	else
+		exec "$CLIENT" -a -t `expr $1 + 1` -i "$2" -s "$3"
+	fi
+fi
+
+# the client's inode and modification time, which change when it's rebuilt
+build() {
+	stat -c '%i %Y' "$CLIENT"
+}
+
+running() {
+	[ -f "$STATE/pids" ] && kill -0 $(cat "$STATE/pids") 2> /dev/null &&
+		[ "$(cat "$STATE/build" 2> /dev/null)" = "$(build)" ]
+}
 
-if [ $# -lt 3 ] ; then
-	"$LOCATION/../build/chessh-client" -a -t `expr $1 + 1` -i "$2"
-else
-	"$LOCATION/../build/chessh-client" -a -t `expr $1 + 1` -i "$2" -s "$3"
+stop() {
+	if [ -f "$STATE/pids" ] ; then
+		kill $(cat "$STATE/pids") 2> /dev/null
+	fi
+	rm -rf "$STATE"
+}
+
+start() {
+	stop
+	mkdir -m 700 "$STATE" || exit 1
+	mkfifo "$STATE/in" "$STATE/out" || exit 1
+	build > "$STATE/build" || exit 1
+	# holds both FIFOs open, so the client never sees EOF between queries
+	# and never writes to a FIFO that nobody has open
+	sleep 2147483647 <> "$STATE/in" 3<> "$STATE/out" > /dev/null 2>&1 &
+	HOLDER=$!
+	"$CLIENT" -S $PERFTREE_FLAGS < "$STATE/in" > "$STATE/out" 2> "$STATE/log" &
+	echo $HOLDER $! > "$STATE/pids"
+}
+
+if [ "$1" = stop ] ; then
+	stop
+	exit 0
 fi
+
+running || start
+
+exec 3> "$STATE/in" 4< "$STATE/out"
+echo "$*" >&3
+
+# the answer is perftree's divide output, which ends with a blank line and the
+# total, or a single error line
+while IFS= read -r line <&4 ; do
+	case "$line" in
+	error:*)
+		echo "$line" >&2
+		exit 1
+		;;
+	"")
+		echo
+		IFS= read -r line <&4
+		echo "$line"
+		exit 0
+		;;
+	*)
+		echo "$line"
+		;;
+	esac
+done
+exit 1